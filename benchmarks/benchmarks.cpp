@@ -0,0 +1,930 @@
+#include "../src/tuples.h"
+#include "../src/tuples_simd.h"
+#include "../src/matrices.h"
+#include "../src/transformations.h"
+#include "../src/canvas.h"
+#include "../src/affine.h"
+#include "../src/tuple_batch.h"
+#include "../src/mapped_canvas.h"
+#include "../src/qoi.h"
+#include "../src/png.h"
+#include "../src/pipeline.h"
+#include "../src/tiled_canvas.h"
+#include "../src/trace.h"
+#include "../src/scene.h"
+#include "../src/camera.h"
+#include "../src/lighting.h"
+#include "../src/arena.h"
+#include "../src/spheres.h"
+#include "../src/bvh.h"
+#include "../src/render.h"
+#include <atomic>
+#include <cmath>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory_resource>
+#include <optional>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+// Usage: benchmarks [filter]
+// Runs every benchmark whose name contains filter. Results go to stdout
+// as JSON, a readable table goes to stderr.
+
+struct Result {
+    std::string name;
+    double ns_per_item;
+    long runs;
+    long items_per_run;
+};
+
+static std::vector<Result> results;
+static const char* filter = nullptr;
+
+// keeps the compiler from discarding benchmark results
+static volatile float sink;
+
+static void consume(float v) {
+    sink = v;
+}
+
+static void consume(const Tuple& t) {
+    sink = t.x;
+}
+
+static void consume(const std::vector<Tuple>& v) {
+    sink = v[v.size() / 2].x;
+}
+
+// Runs fn, which processes `items` elements, until at least 0.2s have
+// passed and records the time per element. A first run that alone takes
+// longer than that is used as the measurement.
+template <typename F>
+void bench(const std::string& name, long items, F fn) {
+    if (filter && name.find(filter) == std::string::npos) return;
+
+    using clock = std::chrono::steady_clock;
+    const auto budget = std::chrono::milliseconds(200);
+
+    auto start = clock::now();
+    fn();
+    auto elapsed = clock::now() - start;
+    long runs = 1;
+
+    if (elapsed < budget) {
+        runs = 0;
+        start = clock::now();
+        do {
+            fn();
+            runs++;
+            elapsed = clock::now() - start;
+        } while (elapsed < budget);
+    }
+
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count()
+        / (static_cast<double>(runs) * items);
+    results.push_back({name, ns, runs, items});
+    std::fprintf(stderr, "%-40s %12.3f ns/item %8ld runs\n", name.c_str(), ns, runs);
+}
+
+// streambuf that throws everything away, to time encoding without I/O
+class NullBuffer : public std::streambuf {
+    protected:
+    int overflow(int c) override { return c; }
+
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+static void tuple_benchmarks() {
+    const int n = 1 << 16;
+    std::vector<Tuple> a(n), b(n), out(n);
+    for (int i = 0; i < n; i++) {
+        a[i] = {i * 0.25f, 1.5f - i, 0.5f * i + 1, 0};
+        b[i] = {2.0f - i, i * 0.75f, 3.0f, 0};
+    }
+    Mat4 m = rotation_x(0.5f) * scaling(2, 3, 4) * translation(1, 2, 3);
+    const float* rows[4] = {m[0], m[1], m[2], m[3]};
+
+    // each kernel from simd::scalar against the version the build selected
+#define TUPLE_BENCH(op, expr)                                               \
+    bench("tuple " #op " (scalar)", n, [&] {                                \
+        namespace ns = simd::scalar;                                        \
+        for (int i = 0; i < n; i++) out[i] = expr;                          \
+        consume(out);                                                       \
+    });                                                                     \
+    bench("tuple " #op " (simd)", n, [&] {                                  \
+        namespace ns = simd;                                                \
+        for (int i = 0; i < n; i++) out[i] = expr;                          \
+        consume(out);                                                       \
+    });
+
+    TUPLE_BENCH(add, ns::add(a[i], b[i]))
+    TUPLE_BENCH(sub, ns::sub(a[i], b[i]))
+    TUPLE_BENCH(mul, ns::mul(a[i], 1.5f))
+    TUPLE_BENCH(dot, ns::mul(a[i], ns::dot(a[i], b[i])))
+    TUPLE_BENCH(cross, ns::cross(a[i], b[i]))
+    TUPLE_BENCH(normalize, ns::normalize(a[i]))
+    TUPLE_BENCH(hadamard, ns::hadamard(a[i], b[i]))
+    TUPLE_BENCH(mat4*tuple, ns::mat_mul(rows, a[i]))
+
+#undef TUPLE_BENCH
+
+    // the public operators, called out of line
+    bench("tuple operator+", n, [&] {
+        for (int i = 0; i < n; i++) out[i] = a[i] + b[i];
+        consume(out);
+    });
+    bench("tuple operator*(scalar)", n, [&] {
+        for (int i = 0; i < n; i++) out[i] = a[i] * 1.5f;
+        consume(out);
+    });
+    bench("tuple dot", n, [&] {
+        float sum = 0;
+        for (int i = 0; i < n; i++) sum += dot(a[i], b[i]);
+        consume(sum);
+    });
+    bench("tuple cross", n, [&] {
+        for (int i = 0; i < n; i++) out[i] = cross(a[i], b[i]);
+        consume(out);
+    });
+    bench("tuple normalize", n, [&] {
+        for (int i = 0; i < n; i++) out[i] = normalize(a[i]);
+        consume(out);
+    });
+    bench("tuple hadamard_product", n, [&] {
+        for (int i = 0; i < n; i++) out[i] = hadamard_product(a[i], b[i]);
+        consume(out);
+    });
+}
+
+static void matrix_benchmarks() {
+    const int n = 1024;
+    Matrix a = {{ -5 , 2 , 6 , -8 },
+                { 1 , -5 , 1 , 8 },
+                { 7 , 7 , -6 , -7 },
+                { 1 , -3 , 7 , 4 } };
+    Matrix b = rotation_y(0.3f) * translation(1, 2, 3);
+    Mat4 a4 = to_mat4(a);
+    Mat4 b4 = to_mat4(b);
+    Tuple p = point(1, 2, 3);
+
+    bench("Matrix * Matrix", n, [&] {
+        Matrix m = a;
+        for (int i = 0; i < n; i++) m = m * b;
+        consume(m[0][0]);
+    });
+    bench("Mat4 * Mat4", n, [&] {
+        Mat4 m = a4;
+        for (int i = 0; i < n; i++) m = m * b4;
+        consume(m[0][0]);
+    });
+    bench("Matrix * Tuple", n, [&] {
+        Tuple t = p;
+        for (int i = 0; i < n; i++) t = b * t;
+        consume(t);
+    });
+    bench("Mat4 * Tuple", n, [&] {
+        Tuple t = p;
+        for (int i = 0; i < n; i++) t = b4 * t;
+        consume(t);
+    });
+    bench("transpose(Matrix)", n, [&] {
+        Matrix m = a;
+        for (int i = 0; i < n; i++) m = transpose(m);
+        consume(m[0][0]);
+    });
+    bench("transpose(Mat4)", n, [&] {
+        Mat4 m = a4;
+        for (int i = 0; i < n; i++) m = transpose(m);
+        consume(m[0][0]);
+    });
+    bench("determinant(Matrix)", n, [&] {
+        float sum = 0;
+        for (int i = 0; i < n; i++) sum += determinant(a);
+        consume(sum);
+    });
+    bench("determinant(Mat4)", n, [&] {
+        Mat4 m = a4;
+        float sum = 0;
+        for (int i = 0; i < n; i++) {
+            m[0][0] = i;
+            sum += determinant(m);
+        }
+        consume(sum);
+    });
+    bench("inverse(Matrix)", n, [&] {
+        Matrix m = a;
+        for (int i = 0; i < n; i++) m = inverse(m);
+        consume(m[0][0]);
+    });
+    bench("inverse(Mat4)", n, [&] {
+        Mat4 m = a4;
+        for (int i = 0; i < n; i++) m = inverse(m);
+        consume(m[0][0]);
+    });
+    bench("checked_inverse(Mat4)", n, [&] {
+        Mat4 m = a4;
+        for (int i = 0; i < n; i++) m = *checked_inverse(m);
+        consume(m[0][0]);
+    });
+
+    Affine af = to_affine(b4);
+    bench("Affine * Affine", n, [&] {
+        Affine m = af;
+        for (int i = 0; i < n; i++) m = m * af;
+        consume(m[0][0]);
+    });
+    bench("transform_point(Affine)", n, [&] {
+        Tuple t = p;
+        for (int i = 0; i < n; i++) t = transform_point(af, t);
+        consume(t);
+    });
+    bench("inverse(Affine)", n, [&] {
+        Affine m = af;
+        for (int i = 0; i < n; i++) m = inverse(m);
+        consume(m[0][0]);
+    });
+
+    Matrix big = {{ 2 , 0 , 1 , 0 , 3 , 1 },
+                  { 0 , 1 , 0 , 4 , 0 , 2 },
+                  { 1 , 0 , 5 , 0 , 1 , 0 },
+                  { 0 , 2 , 0 , 1 , 0 , 1 },
+                  { 3 , 0 , 1 , 0 , 7 , 0 },
+                  { 1 , 1 , 1 , 1 , 1 , 9 } };
+    bench("inverse(Matrix 6x6, LU)", n, [&] {
+        Matrix m = big;
+        for (int i = 0; i < n; i++) m = inverse(m);
+        consume(m[0][0]);
+    });
+}
+
+static void transformation_benchmarks() {
+    const int n = 4096;
+
+#define BUILDER_BENCH(name, expr)                                           \
+    bench(name, n, [&] {                                                    \
+        float sum = 0;                                                      \
+        for (int i = 0; i < n; i++) {                                       \
+            float v = i * 0.001f;                                           \
+            sum += (expr)[0][1];                                            \
+        }                                                                   \
+        consume(sum);                                                       \
+    });
+
+    BUILDER_BENCH("translation", translation(v, 2, 3))
+    BUILDER_BENCH("scaling", scaling(v, 2, 3))
+    BUILDER_BENCH("rotation_x", rotation_x(v))
+    BUILDER_BENCH("rotation_y", rotation_y(v))
+    BUILDER_BENCH("rotation_z", rotation_z(v))
+    BUILDER_BENCH("shearing", shearing(v, 0, 1, 0, 0, 1))
+    BUILDER_BENCH("rotation_z * scaling * translation",
+        rotation_z(v) * scaling(2, 2, 2) * translation(v, 0, 0))
+    BUILDER_BENCH("TransformChain translate.scale.rotate_z",
+        TransformChain().translate(v, 0, 0).scale(2, 2, 2).rotate_z(v).matrix())
+
+#undef BUILDER_BENCH
+}
+
+static void batch_benchmarks() {
+    const int n = 1 << 20;
+    Mat4 m = translation(1, 2, 3) * rotation_y(0.3f) * scaling(2, 2, 2);
+    Matrix mm = m;
+    std::vector<Tuple> aos(n), aos_out(n);
+    TupleBatch soa, soa_out;
+    for (int i = 0; i < n; i++) {
+        aos[i] = point(i * 0.001f, 1 - i * 0.002f, 0.5f);
+        soa.push_back(aos[i]);
+    }
+
+    bench("Matrix * Tuple, 1M points", n, [&] {
+        for (int i = 0; i < n; i++) aos_out[i] = mm * aos[i];
+        consume(aos_out);
+    });
+    bench("Mat4 * Tuple, 1M points", n, [&] {
+        for (int i = 0; i < n; i++) aos_out[i] = m * aos[i];
+        consume(aos_out);
+    });
+
+    BatchOptions serial;
+    serial.parallel_threshold = n + 1;
+    std::string kernel = batch_uses_avx2() ? " (avx2)" : " (no avx2)";
+    bench("TupleBatch transform, 1M points, 1 thread" + kernel, n, [&] {
+        transform(m, soa, soa_out, serial);
+        consume(soa_out.x[n / 2]);
+    });
+    bench("TupleBatch transform, 1M points, pool" + kernel, n, [&] {
+        transform(m, soa, soa_out);
+        consume(soa_out.x[n / 2]);
+    });
+}
+
+static void bvh_benchmarks() {
+    unsigned seed = 42;
+    auto random = [&seed](float lo, float hi) {
+        seed = seed * 1664525u + 1013904223u;
+        return lo + (hi - lo) * ((seed >> 8) / 16777216.0f);
+    };
+
+    // a 32x32 grid of rays from in front of the spheres, like one tile
+    const int n = 1024;
+    std::vector<Ray> rays(n);
+    for (int i = 0; i < n; i++) {
+        Tuple target = point(-10 + (i % 32) * 0.625f, -10 + (i / 32) * 0.625f, 0);
+        rays[i] = {point(0, 0, -30), normalize(target - point(0, 0, -30))};
+    }
+
+    for (int count : {100, 1000, 10000}) {
+        std::vector<Sphere> spheres(count);
+        for (Sphere& s : spheres) {
+            float r = random(0.05f, 0.5f);
+            s.transform = translation(random(-10, 10), random(-10, 10), random(-10, 10))
+                * scaling(r, r, r);
+        }
+        std::string suffix = ", " + std::to_string(count) + " spheres";
+
+        bench("bvh build" + suffix, count, [&] {
+            Bvh bvh(spheres);
+            consume(static_cast<float>(bvh.nodes.size()));
+        });
+
+        Bvh bvh(spheres);
+        BvhTraversalStats stats;
+        std::string name = "closest_hit, bvh" + suffix;
+        bench(name, n, [&] {
+            stats = {};
+            float sum = 0;
+            for (const Ray& r : rays) {
+                std::optional<Intersection> h = bvh.closest_hit(r, &stats);
+                sum += h ? h->t : 0;
+            }
+            consume(sum);
+        });
+        if (!results.empty() && results.back().name == name) {
+            std::fprintf(stderr, "    %d nodes, depth %d, %.1f%% hit, %.1f nodes and "
+                "%.1f primitives per ray\n", bvh.build_stats.nodes,
+                bvh.build_stats.max_depth, 100.0 * stats.hits / stats.rays,
+                stats.nodes_per_ray(), stats.primitives_per_ray());
+        }
+
+        Intersections xs;
+        bench("closest_hit, linear scan" + suffix, n, [&] {
+            float sum = 0;
+            for (const Ray& r : rays) {
+                xs.clear();
+                intersect(spheres, r, xs);
+                const Intersection* h = hit(xs);
+                sum += h ? h->t : 0;
+            }
+            consume(sum);
+        });
+    }
+}
+
+static void canvas_benchmarks() {
+    struct Size {
+        const char* name;
+        int width;
+        int height;
+    };
+    const Size sizes[] = {{"1080p", 1920, 1080}, {"4K", 3840, 2160}};
+
+    for (const Size& s : sizes) {
+        long pixels = static_cast<long>(s.width) * s.height;
+        std::string suffix = std::string(" ") + s.name;
+
+        bench("Canvas construction" + suffix, pixels, [&] {
+            Canvas c(s.width, s.height);
+            consume(c.pixel_at(s.width - 1, s.height - 1));
+        });
+
+        Canvas c(s.width, s.height);
+        for (int y = 0; y < s.height; y++) {
+            std::span<Tuple> row = c.row(y);
+            for (int x = 0; x < s.width; x++) {
+                row[x] = color(x / float(s.width), y / float(s.height), 0.5f);
+            }
+        }
+
+        bench("write_pixel" + suffix, pixels, [&] {
+            for (int y = 0; y < s.height; y++) {
+                for (int x = 0; x < s.width; x++) {
+                    c.write_pixel(x, y, color(0.5f, 0.25f, 0.125f));
+                }
+            }
+        });
+        bench("to_ppm" + suffix, pixels, [&] {
+            std::string ppm = c.to_ppm();
+            consume(ppm[ppm.size() / 2]);
+        });
+
+        NullBuffer null_buffer;
+        std::ostream null_stream(&null_buffer);
+        bench("write_ppm P3" + suffix, pixels, [&] {
+            c.write_ppm(null_stream, PpmFormat::P3);
+        });
+        bench("write_ppm P6" + suffix, pixels, [&] {
+            c.write_ppm(null_stream, PpmFormat::P6);
+        });
+
+        bench("write_qoi" + suffix, pixels, [&] {
+            write_qoi(null_stream, c);
+        });
+        bench("write_png" + suffix, pixels, [&] {
+            write_png(null_stream, c);
+        });
+        PngOptions one_thread;
+        ThreadPool single(1);
+        one_thread.pool = &single;
+        bench("write_png 1 thread" + suffix, pixels, [&] {
+            write_png(null_stream, c, one_thread);
+        });
+
+        // the same image in each compact pixel format
+        auto format_benchmarks = [&](auto& compact, const char* format) {
+            std::string name = std::string(" ") + format + suffix;
+            for (int y = 0; y < s.height; y++) {
+                for (int x = 0; x < s.width; x++) {
+                    compact.write_pixel(x, y, c.pixel_at(x, y));
+                }
+            }
+            bench("write_pixel" + name, pixels, [&] {
+                for (int y = 0; y < s.height; y++) {
+                    for (int x = 0; x < s.width; x++) {
+                        compact.write_pixel(x, y, color(0.5f, 0.25f, 0.125f));
+                    }
+                }
+            });
+            bench("write_ppm P3" + name, pixels, [&] {
+                compact.write_ppm(null_stream, PpmFormat::P3);
+            });
+            bench("write_ppm P6" + name, pixels, [&] {
+                compact.write_ppm(null_stream, PpmFormat::P6);
+            });
+            bench("write_qoi" + name, pixels, [&] {
+                write_qoi(null_stream, compact);
+            });
+            bench("write_png" + name, pixels, [&] {
+                write_png(null_stream, compact);
+            });
+        };
+        {
+            Rgb8Canvas compact(s.width, s.height);
+            format_benchmarks(compact, "Rgb8");
+        }
+        {
+            Rgb16fCanvas compact(s.width, s.height);
+            format_benchmarks(compact, "Rgb16f");
+        }
+        {
+            Rgb32fCanvas compact(s.width, s.height);
+            format_benchmarks(compact, "Rgb32f");
+        }
+
+        MappedCanvas mapped("benchmark-canvas.bin", s.width, s.height);
+        bench("MappedCanvas write_pixel" + suffix, pixels, [&] {
+            for (int y = 0; y < s.height; y++) {
+                for (int x = 0; x < s.width; x++) {
+                    mapped.write_pixel(x, y, color(0.5f, 0.25f, 0.125f));
+                }
+            }
+        });
+        bench("MappedCanvas write_ppm P6" + suffix, pixels, [&] {
+            mapped.write_ppm(null_stream, PpmFormat::P6);
+        });
+        std::remove("benchmark-canvas.bin");
+    }
+}
+
+static void layout_benchmarks() {
+    const int width = 3840, height = 2160;
+    const long pixels = static_cast<long>(width) * height;
+    Canvas linear(width, height);
+    TiledCanvas<Tuple> tiled(width, height);
+
+    // pixel by pixel within 16x16 tiles, the order render() writes in
+    auto tile_writes = [&](auto& c) {
+        for (int ty = 0; ty < height; ty += 16) {
+            for (int tx = 0; tx < width; tx += 16) {
+                for (int y = ty; y < ty + 16; y++) {
+                    for (int x = tx; x < tx + 16; x++) {
+                        c.write_pixel(x, y, color(0.5f, 0.25f, 0.125f));
+                    }
+                }
+            }
+        }
+    };
+    bench("tile writes, linear 4K", pixels, [&] { tile_writes(linear); });
+    bench("tile writes, tiled 4K", pixels, [&] { tile_writes(tiled); });
+    // a renderer that knows the layout fills whole tiles in memory order
+    bench("tile writes via tile(), tiled 4K", pixels, [&] {
+        for (int ty = 0; ty < height / 8; ty++) {
+            for (int tx = 0; tx < width / 8; tx++) {
+                for (Tuple& p : tiled.tile(tx, ty)) p = color(0.5f, 0.25f, 0.125f);
+            }
+        }
+    });
+
+    // a 3x3 box filter reads each pixel's neighbours in the rows around it
+    auto box_filter = [&](auto& c) {
+        float sum = 0;
+        for (int y = 1; y < height - 1; y++) {
+            for (int x = 1; x < width - 1; x++) {
+                for (int dy = -1; dy <= 1; dy++) {
+                    for (int dx = -1; dx <= 1; dx++) sum += c.pixel_at(x + dx, y + dy).x;
+                }
+            }
+        }
+        consume(sum);
+    };
+    bench("3x3 filter reads, linear 4K", pixels, [&] { box_filter(linear); });
+    bench("3x3 filter reads, tiled 4K", pixels, [&] { box_filter(tiled); });
+
+    bench("full-frame column reads, linear 4K", pixels, [&] {
+        float sum = 0;
+        for (int x = 0; x < width; x++) {
+            for (int y = 0; y < height; y++) sum += linear.pixel_at(x, y).x;
+        }
+        consume(sum);
+    });
+    bench("full-frame column reads, tiled 4K", pixels, [&] {
+        float sum = 0;
+        for (int x = 0; x < width; x++) {
+            for (int y = 0; y < height; y++) sum += tiled.pixel_at(x, y).x;
+        }
+        consume(sum);
+    });
+
+    NullBuffer null_buffer;
+    std::ostream null_stream(&null_buffer);
+    bench("write_ppm P6, linear 4K", pixels, [&] {
+        linear.write_ppm(null_stream, PpmFormat::P6);
+    });
+    bench("write_ppm P6, tiled 4K", pixels, [&] {
+        tiled.write_ppm(null_stream, PpmFormat::P6);
+    });
+}
+
+static void pipeline_benchmarks() {
+    const int width = 1920, height = 1080;
+    const long pixels = static_cast<long>(width) * height;
+    // enough work per pixel that rendering and encoding are comparable
+    auto shade = [](int x, int y) {
+        float v = std::sin(x * 0.01f) * std::cos(y * 0.01f);
+        return color(0.5f + 0.5f * v, x / 1920.0f, y / 1080.0f);
+    };
+    NullBuffer null_buffer;
+    std::ostream null_stream(&null_buffer);
+
+    bench("render then write_ppm P3 1080p", pixels, [&] {
+        Canvas c(width, height);
+        render(c, shade);
+        c.write_ppm(null_stream, PpmFormat::P3);
+    });
+
+    PipelineStats stats;
+    bench("render_ppm pipelined P3 1080p", pixels, [&] {
+        stats = render_ppm(null_stream, width, height, shade);
+    });
+    if (stats.bands > 0) std::fprintf(stderr, "    last run: %.1f ms total, writer busy %.1f ms, "
+        "writer stalled %.1f ms, render stalled %.1f ms\n", stats.total_ms, 
+        stats.writer_busy_ms, stats.writer_stall_ms, stats.render_stall_ms);
+}
+
+// the same work in float and double
+template <typename T>
+static void precision_benchmark(const std::string& suffix) {
+    const int n = 4096;
+    BasicMat4<T> m = translation<T>(1, 2, 3) * rotation_y<T>(0.5) * scaling<T>(2, 2, 2);
+    std::vector<BasicTuple<T>> points(n);
+    for (int i = 0; i < n; i++) points[i] = point<T>(i, i * 0.5, -i);
+
+    bench("Mat4 * point " + suffix, n, [&] {
+        T sum = 0;
+        for (const BasicTuple<T>& p : points) sum += (m * p).x;
+        consume(static_cast<float>(sum));
+    });
+    bench("inverse(Mat4) " + suffix, n, [&] {
+        T sum = 0;
+        for (int i = 0; i < n; i++) {
+            BasicMat4<T> t = m;
+            t[0][3] = static_cast<T>(i);
+            sum += inverse(t)[0][3];
+        }
+        consume(static_cast<float>(sum));
+    });
+}
+
+static void precision_benchmarks() {
+    precision_benchmark<float>("float");
+    precision_benchmark<double>("double");
+}
+
+static void scene_benchmarks() {
+    // 100 groups of 100 spheres; one group or all of them move per frame
+    Scene scene;
+    std::vector<NodeId> groups;
+    for (int g = 0; g < 100; g++) {
+        groups.push_back(scene.add_group(Scene::root, translation(g, 0, 0)));
+        for (int i = 0; i < 100; i++) {
+            scene.add_sphere(groups.back(), translation(0, i, 0) * scaling(0.4, 0.4, 0.4));
+        }
+    }
+    scene.update();
+    const long nodes = scene.size();
+
+    int frame = 0;
+    bench("Scene::update, nothing moved", nodes, [&] {
+        consume(static_cast<float>(scene.update().reused));
+    });
+    bench("Scene::update, 1 of 100 groups moved", nodes, [&] {
+        frame++;
+        scene.set_transform(groups[frame % 100], translation(frame % 100, frame * 0.01f, 0));
+        consume(static_cast<float>(scene.update().recomputed));
+    });
+    bench("Scene::update, every group moved", nodes, [&] {
+        frame++;
+        for (int g = 0; g < 100; g++) {
+            scene.set_transform(groups[g], translation(g, frame * 0.01f, 0));
+        }
+        consume(static_cast<float>(scene.update().recomputed));
+    });
+}
+
+// generates every primary ray, 16x16 tiles at a time, on this thread
+static float all_tiles(const Camera& camera) {
+    RayPacket rays;
+    float sum = 0;
+    for (int y = 0; y < camera.vsize(); y += 16) {
+        for (int x = 0; x < camera.hsize(); x += 16) {
+            camera.rays_for_tile({x, y, std::min(x + 16, camera.hsize()),
+                std::min(y + 16, camera.vsize())}, rays);
+            sum += rays.dx[0];
+        }
+    }
+    return sum;
+}
+
+static void camera_benchmarks() {
+    const int w = 640, h = 480;
+    Camera camera(w, h, M_PI / 3, view_transform(point(0, 1.5, -5), point(0, 1, 0), vector(0, 1, 0)));
+    const long pixels = static_cast<long>(w) * h;
+
+    // what every pixel costs without the cache
+    bench("primary rays, inverse per pixel", pixels, [&] {
+        float sum = 0;
+        for (int py = 0; py < h; py++) {
+            for (int px = 0; px < w; px++) {
+                Mat4 inv = inverse(camera.transform());
+                float x = (w / 2 - px - 0.5f) * camera.pixel_size();
+                float y = (h / 2 - py - 0.5f) * camera.pixel_size();
+                Tuple origin = inv * point(0, 0, 0);
+                sum += normalize(inv * point(x, y, -1) - origin).x;
+            }
+        }
+        consume(sum);
+    });
+    bench("Camera::rays_for_tile, still camera", pixels, [&] {
+        consume(all_tiles(camera));
+    });
+    int frame = 0;
+    bench("Camera::rays_for_tile, moving camera", pixels, [&] {
+        frame++;
+        camera.set_transform(view_transform(point(frame * 0.001f, 1.5, -5), 
+            point(0, 1, 0), vector(0, 1, 0)));
+        consume(all_tiles(camera));
+    });
+}
+
+static void lighting_benchmarks() {
+    const int n = 4096;
+    PointLight light {point(-10, 10, -10), color(1, 1, 1)};
+    Material m;
+    std::vector<Tuple> points(n), normals(n), eyes(n);
+    HitBatch hits;
+    for (int i = 0; i < n; i++) {
+        float a = i * 0.001f;
+        points[i] = point(std::cos(a), std::sin(a), 0);
+        normals[i] = normalize(vector(std::cos(a), std::sin(a), -0.3f));
+        eyes[i] = normalize(vector(0.1f, 0.2f, -1));
+        hits.push_back(points[i], eyes[i], normals[i], m);
+    }
+
+    bench("lighting, one hit at a time", n, [&] {
+        float sum = 0;
+        for (int i = 0; i < n; i++) sum += lighting(m, light, points[i], eyes[i], normals[i]).x;
+        consume(sum);
+    });
+    TupleBatch out;
+    bench("lighting(HitBatch), exact pow", n, [&] {
+        lighting(light, hits, out, PowMode::exact);
+        consume(out.x[n / 2]);
+    });
+    bench("lighting(HitBatch), bounded pow", n, [&] {
+        lighting(light, hits, out, PowMode::bounded);
+        consume(out.x[n / 2]);
+    });
+    bench("lighting(HitBatch), fast pow", n, [&] {
+        lighting(light, hits, out, PowMode::fast);
+        consume(out.x[n / 2]);
+    });
+}
+
+// Heap memory for std::pmr containers, counting every allocation, so the
+// benchmarks below can report allocations per frame
+class CountingResource : public std::pmr::memory_resource {
+    public:
+    std::atomic<long> calls {0};
+
+    private:
+    void* do_allocate(std::size_t bytes, std::size_t align) override {
+        calls.fetch_add(1, std::memory_order_relaxed);
+        return std::pmr::new_delete_resource()->allocate(bytes, align);
+    }
+
+    void do_deallocate(void* p, std::size_t bytes, std::size_t align) override {
+        std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+static void intersection_benchmarks() {
+    // every ray hits 12 spheres, more than fits inline in Intersections
+    std::vector<Sphere> spheres(12);
+    for (int i = 0; i < 12; i++) {
+        spheres[i].transform = translation(0, 0, i * 0.1f) * scaling(2, 2, 2);
+    }
+    const int size = 128;
+    const long pixels = size * size;
+    auto ray_at = [](int x, int y) {
+        return Ray {point(x * 0.005f, y * 0.005f, -5), vector(0, 0, 1)};
+    };
+    ThreadPool one_thread(1);
+    CountingResource heap;
+    long allocations = 0;
+
+    auto report = [&](const char* name) {
+        if (!results.empty() && results.back().name == name) {
+            std::fprintf(stderr, "    last frame: %ld allocations\n", allocations);
+        }
+    };
+
+    const char* fresh = "intersect 12 spheres, fresh std::vector per ray";
+    bench(fresh, pixels, [&] {
+        long before = heap.calls.load();
+        float sum = 0;
+        for_each_tile(size, size, [&](const Tile& t) {
+            for (int y = t.y0; y < t.y1; y++) {
+                for (int x = t.x0; x < t.x1; x++) {
+                    // what a naive intersect() returning a vector costs
+                    Ray r = ray_at(x, y);
+                    std::pmr::vector<Intersection> xs(&heap);
+                    for (const Sphere& s : spheres) {
+                        Intersections found;
+                        intersect(s, r, found);
+                        xs.insert(xs.end(), found.begin(), found.end());
+                    }
+                    sort_intersections(xs);
+                    sum += xs.empty() ? 0 : xs[0].t;
+                }
+            }
+        }, {16, &one_thread});
+        allocations = heap.calls.load() - before;
+        consume(sum);
+    });
+    report(fresh);
+
+    const char* arena = "intersect 12 spheres, arena-backed list";
+    bench(arena, pixels, [&] {
+        long before = Arena::heap_allocations();
+        float sum = 0;
+        for_each_tile(size, size, [&](const Tile& t) {
+            for (int y = t.y0; y < t.y1; y++) {
+                for (int x = t.x0; x < t.x1; x++) {
+                    Intersections xs(&thread_arena());
+                    intersect(spheres, ray_at(x, y), xs);
+                    sum += xs.empty() ? 0 : xs[0].t;
+                }
+            }
+        }, {16, &one_thread});
+        allocations = Arena::heap_allocations() - before;
+        consume(sum);
+    });
+    report(arena);
+}
+
+static void shadow_benchmarks() {
+    unsigned seed = 99;
+    auto random = [&seed](float lo, float hi) {
+        seed = seed * 1664525u + 1013904223u;
+        return lo + (hi - lo) * ((seed >> 8) / 16777216.0f);
+    };
+    std::vector<Sphere> spheres(5000);
+    for (Sphere& s : spheres) {
+        float r = random(0.05f, 0.4f);
+        s.transform = translation(random(-20, 20), random(0, 5), random(-20, 20))
+            * scaling(r, r, r);
+    }
+    Bvh bvh(spheres);
+    PointLight light {point(-10, 40, -10), color(1, 1, 1)};
+
+    // a 64x64 patch of floor under a layer of spheres, coherent like the
+    // hit points of one tile
+    const int n = 4096;
+    std::vector<Tuple> points(n);
+    for (int i = 0; i < n; i++) {
+        points[i] = point(-5 + (i % 64) * 0.15f, -0.5f, -5 + (i / 64) * 0.15f);
+    }
+    std::vector<char> occluded(n);
+    BvhTraversalStats stats;
+
+    auto report = [&](const char* name) {
+        if (!results.empty() && results.back().name == name) {
+            std::fprintf(stderr, "    %ld rays, %.1f%% blocked, %.1f nodes and %.1f "
+                "primitives per ray\n", stats.rays, 100.0 * stats.hits / stats.rays,
+                stats.nodes_per_ray(), stats.primitives_per_ray());
+        }
+    };
+
+    const char* closest = "shadow rays, closest_hit";
+    bench(closest, n, [&] {
+        stats = {};
+        for (int i = 0; i < n; i++) {
+            Tuple to_light = light.position - points[i];
+            float distance = to_light.magnitude();
+            std::optional<Intersection> h = bvh.closest_hit({points[i], to_light / distance}, &stats);
+            occluded[i] = h && h->t < distance;
+        }
+        consume(occluded[n / 2]);
+    });
+    report(closest);
+
+    const char* any = "shadow rays, is_occluded";
+    bench(any, n, [&] {
+        stats = {};
+        for (int i = 0; i < n; i++) occluded[i] = bvh.is_occluded(points[i], light, &stats);
+        consume(occluded[n / 2]);
+    });
+    report(any);
+
+    const char* packets = "shadow rays, is_occluded packets of 64";
+    bench(packets, n, [&] {
+        stats = {};
+        bvh.is_occluded(points, light, occluded, &stats);
+        consume(occluded[n / 2]);
+    });
+    report(packets);
+}
+
+static void trace_benchmarks() {
+    // what a TRACE_SCOPE / TRACE_COUNT costs when tracing is compiled in
+    const int n = 1 << 14;
+    bench("trace::Scope", n, [&] {
+        trace::clear();
+        for (int i = 0; i < n; i++) trace::Scope s {"bench"};
+    });
+    bench("trace::count", n, [&] {
+        for (int i = 0; i < n; i++) trace::count(trace::Counter::pixels_written);
+    });
+    trace::clear();
+}
+
+static void print_json() {
+    std::printf("{\n  \"benchmarks\": [\n");
+    for (std::size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        std::printf("    {\"name\": \"%s\", \"ns_per_item\": %.4f, "
+            "\"runs\": %ld, \"items_per_run\": %ld}%s\n",
+            r.name.c_str(), r.ns_per_item, r.runs, r.items_per_run,
+            i + 1 < results.size() ? "," : "");
+    }
+    std::printf("  ]\n}\n");
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1) filter = argv[1];
+
+    tuple_benchmarks();
+    matrix_benchmarks();
+    transformation_benchmarks();
+    batch_benchmarks();
+    bvh_benchmarks();
+    canvas_benchmarks();
+    layout_benchmarks();
+    pipeline_benchmarks();
+    precision_benchmarks();
+    scene_benchmarks();
+    camera_benchmarks();
+    lighting_benchmarks();
+    intersection_benchmarks();
+    shadow_benchmarks();
+    trace_benchmarks();
+
+    print_json();
+    return 0;
+}
@@ -0,0 +1,42 @@
+#include "affine.h"
+
+bool isAffine(const Mat4& m) {
+    return m[3][0] == 0 && m[3][1] == 0 && m[3][2] == 0 && m[3][3] == 1;
+}
+
+bool operator==(const Affine& a1, const Affine& a2) {
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 4; j++) {
+            if (!equal(a1[i][j], a2[i][j])) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool operator!=(const Affine& a1, const Affine& a2) {
+    return !(a1 == a2);
+}
+
+Mat4 operator*(const Mat4& m, const Affine& a) {
+    return m * to_mat4(a);
+}
+
+Mat4 operator*(const Affine& a, const Mat4& m) {
+    return to_mat4(a) * m;
+}
+
+bool isInvertible(const Affine& a) {
+    return determinant(a) != 0;
+}
+
+std::optional<Affine> checked_inverse(const Affine& a) {
+    TRACE_COUNT(inversions, 1);
+    Affine res {};
+    float det = affine_detail::inverse3(a, res);
+    if (det == 0 || !std::isfinite(det)) {
+        return std::nullopt;
+    }
+    return res;
+}
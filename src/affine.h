@@ -0,0 +1,142 @@
+#ifndef AFFINE_H
+#define AFFINE_H
+
+#include <optional>
+#include <type_traits>
+#include "matrices.h"
+#include "tuples.h"
+
+// Affine transformation stored as the top three rows of a 4x4 matrix;
+// the bottom row is always 0 0 0 1 and is not stored.
+// All of the transformation builders produce affine matrices.
+struct alignas(16) Affine {
+    float m[3][4];
+
+    constexpr float* operator[](int row) { return m[row]; }
+
+    constexpr const float* operator[](int row) const { return m[row]; }
+};
+
+static_assert(std::is_trivially_copyable<Affine>::value, 
+    "Affine must be trivially copyable");
+
+namespace matrices {
+    constexpr Affine identity_affine = {{{1, 0, 0, 0},
+                                        {0, 1, 0, 0},
+                                        {0, 0, 1, 0}}};
+}
+
+// true if the bottom row of m is 0 0 0 1
+bool isAffine(const Mat4& m);
+
+// drops the bottom row, which must be 0 0 0 1
+constexpr Affine to_affine(const Mat4& m) {
+    return {{{m[0][0], m[0][1], m[0][2], m[0][3]},
+             {m[1][0], m[1][1], m[1][2], m[1][3]},
+             {m[2][0], m[2][1], m[2][2], m[2][3]}}};
+}
+
+constexpr Mat4 to_mat4(const Affine& a) {
+    return {{{a[0][0], a[0][1], a[0][2], a[0][3]},
+             {a[1][0], a[1][1], a[1][2], a[1][3]},
+             {a[2][0], a[2][1], a[2][2], a[2][3]},
+             {0, 0, 0, 1}}};
+}
+
+bool operator==(const Affine& a1, const Affine& a2);
+
+bool operator!=(const Affine& a1, const Affine& a2);
+
+constexpr Affine operator*(const Affine& a1, const Affine& a2) {
+    if (!std::is_constant_evaluated()) TRACE_COUNT(matrix_multiplies, 1);
+    Affine res {};
+
+    // the implicit bottom row of a2 only adds a1's translation
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 4; j++) {
+            res[i][j] = a1[i][0] * a2[0][j] +
+                        a1[i][1] * a2[1][j] +
+                        a1[i][2] * a2[2][j];
+        }
+        res[i][3] += a1[i][3];
+    }
+    return res;
+}
+
+// mixing with a general matrix gives a general matrix
+Mat4 operator*(const Mat4& m, const Affine& a);
+
+Mat4 operator*(const Affine& a, const Mat4& m);
+
+// any tuple; w is left unchanged
+constexpr Tuple operator*(const Affine& a, const Tuple& t) {
+    return {a[0][0] * t.x + a[0][1] * t.y + a[0][2] * t.z + a[0][3] * t.w,
+            a[1][0] * t.x + a[1][1] * t.y + a[1][2] * t.z + a[1][3] * t.w,
+            a[2][0] * t.x + a[2][1] * t.y + a[2][2] * t.z + a[2][3] * t.w,
+            t.w};
+}
+
+// 9 multiply-adds plus the translation
+constexpr Tuple transform_point(const Affine& a, const Tuple& p) {
+    return {a[0][0] * p.x + a[0][1] * p.y + a[0][2] * p.z + a[0][3],
+            a[1][0] * p.x + a[1][1] * p.y + a[1][2] * p.z + a[1][3],
+            a[2][0] * p.x + a[2][1] * p.y + a[2][2] * p.z + a[2][3],
+            1};
+}
+
+// 9 multiply-adds, translation does not apply
+constexpr Tuple transform_vector(const Affine& a, const Tuple& v) {
+    return {a[0][0] * v.x + a[0][1] * v.y + a[0][2] * v.z,
+            a[1][0] * v.x + a[1][1] * v.y + a[1][2] * v.z,
+            a[2][0] * v.x + a[2][1] * v.y + a[2][2] * v.z,
+            0};
+}
+
+// determinant of the 3x3 linear part, equal to that of the full matrix
+constexpr float determinant(const Affine& a) {
+    return a[0][0] * (a[1][1] * a[2][2] - a[1][2] * a[2][1])
+         - a[0][1] * (a[1][0] * a[2][2] - a[1][2] * a[2][0])
+         + a[0][2] * (a[1][0] * a[2][1] - a[1][1] * a[2][0]);
+}
+
+bool isInvertible(const Affine& a);
+
+namespace affine_detail {
+    // Inverse of [A t] is [A^-1  -A^-1 t]; A^-1 is the 3x3 adjugate over the
+    // determinant. Returns the determinant.
+    constexpr float inverse3(const Affine& a, Affine& res) {
+        float c00 = a[1][1] * a[2][2] - a[1][2] * a[2][1];
+        float c01 = a[1][2] * a[2][0] - a[1][0] * a[2][2];
+        float c02 = a[1][0] * a[2][1] - a[1][1] * a[2][0];
+        float det = a[0][0] * c00 + a[0][1] * c01 + a[0][2] * c02;
+        float inv_det = 1 / det;
+
+        res[0][0] = c00 * inv_det;
+        res[1][0] = c01 * inv_det;
+        res[2][0] = c02 * inv_det;
+        res[0][1] = (a[0][2] * a[2][1] - a[0][1] * a[2][2]) * inv_det;
+        res[1][1] = (a[0][0] * a[2][2] - a[0][2] * a[2][0]) * inv_det;
+        res[2][1] = (a[0][1] * a[2][0] - a[0][0] * a[2][1]) * inv_det;
+        res[0][2] = (a[0][1] * a[1][2] - a[0][2] * a[1][1]) * inv_det;
+        res[1][2] = (a[0][2] * a[1][0] - a[0][0] * a[1][2]) * inv_det;
+        res[2][2] = (a[0][0] * a[1][1] - a[0][1] * a[1][0]) * inv_det;
+
+        for (int i = 0; i < 3; i++) {
+            res[i][3] = -(res[i][0] * a[0][3] + res[i][1] * a[1][3] + res[i][2] * a[2][3]);
+        }
+        return det;
+    }
+}
+
+// Not checked: a singular transform produces inf/nan entries.
+constexpr Affine inverse(const Affine& a) {
+    if (!std::is_constant_evaluated()) TRACE_COUNT(inversions, 1);
+    Affine res {};
+    affine_detail::inverse3(a, res);
+    return res;
+}
+
+// Empty if a is not invertible.
+std::optional<Affine> checked_inverse(const Affine& a);
+
+#endif
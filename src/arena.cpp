@@ -0,0 +1,83 @@
+#include "arena.h"
+#include <algorithm>
+#include <atomic>
+#include <new>
+
+static std::atomic<long> heap_calls {0};
+
+// blocks are cache-line aligned so allocations can be too
+static const std::align_val_t block_align {64};
+
+Arena::Arena(std::size_t block_size) : block_size {block_size} {
+}
+
+Arena::~Arena() {
+    for (Block& b : blocks) {
+        ::operator delete(b.data, block_align);
+    }
+}
+
+// The current block is full: move on to the next block that fits, or add
+// one. Oversized requests get a block of their own size. Block starts are
+// 64-byte aligned, which satisfies any align.
+void* Arena::allocate_slow(std::size_t bytes, std::size_t) {
+    std::size_t next = blocks.empty() ? 0 : current + 1;
+    std::size_t fit = next;
+    while (fit < blocks.size() && blocks[fit].size < bytes) {
+        fit++;
+    }
+    if (fit == blocks.size()) {
+        std::size_t size = std::max(block_size, bytes);
+        heap_calls.fetch_add(1, std::memory_order_relaxed);
+        blocks.push_back({static_cast<std::byte*>(::operator new(size, block_align)), size});
+    }
+    // keep the blocks in the order they are used
+    std::swap(blocks[next], blocks[fit]);
+    current = next;
+    offset = bytes;
+    return blocks[current].data;
+}
+
+void Arena::reset() {
+    rewind({0, 0});
+}
+
+// allocate_slow() only reorders blocks after the current one, so the
+// blocks up to m.block still hold what was allocated before the mark
+void Arena::rewind(Mark m) {
+    current = m.block;
+    offset = m.offset;
+    gen++;
+}
+
+std::size_t Arena::used() const {
+    std::size_t total = offset;
+    for (std::size_t i = 0; i < current && i < blocks.size(); i++) {
+        total += blocks[i].size;
+    }
+    return total;
+}
+
+std::size_t Arena::capacity() const {
+    std::size_t total = 0;
+    for (const Block& b : blocks) total += b.size;
+    return total;
+}
+
+void* Arena::heap_allocate(std::size_t bytes) {
+    heap_calls.fetch_add(1, std::memory_order_relaxed);
+    return ::operator new(bytes);
+}
+
+void Arena::heap_free(void* p) {
+    ::operator delete(p);
+}
+
+long Arena::heap_allocations() {
+    return heap_calls.load(std::memory_order_relaxed);
+}
+
+Arena& thread_arena() {
+    thread_local Arena arena;
+    return arena;
+}
@@ -0,0 +1,94 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <vector>
+
+// Bump allocator for short-lived per-ray data. allocate() hands out the
+// next bytes of a block; nothing is freed on its own, reset() takes the
+// whole arena back at once and keeps the blocks for next time. After the
+// first tile or two a reset arena never goes back to the heap.
+//
+// Not thread safe: use one per thread, e.g. thread_arena().
+class Arena {
+    public:
+    explicit Arena(std::size_t block_size = 64 * 1024);
+
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+
+    Arena& operator=(const Arena&) = delete;
+
+    // align must be a power of two, at most 64
+    void* allocate(std::size_t bytes, std::size_t align = alignof(std::max_align_t)) {
+        std::size_t start = (offset + align - 1) & ~(align - 1);
+        if (current < blocks.size() && start + bytes <= blocks[current].size) {
+            offset = start + bytes;
+            return blocks[current].data + start;
+        }
+        return allocate_slow(bytes, align);
+    }
+
+    // room for n objects of type T, not constructed
+    template <typename T>
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+    }
+
+    // Frees everything allocated since the last reset, keeping the blocks.
+    // Memory from before the reset must not be used any more.
+    void reset();
+
+    // where the next allocation would go, for rewind()
+    struct Mark {
+        std::size_t block;
+        std::size_t offset;
+    };
+
+    Mark mark() const { return {current, offset}; }
+
+    // Frees everything allocated since m was taken, and nothing before it
+    void rewind(Mark m);
+
+    // goes up by one on every reset() and rewind()
+    unsigned generation() const { return gen; }
+
+    // bytes handed out since the last reset, including alignment padding
+    std::size_t used() const;
+
+    // bytes in all blocks
+    std::size_t capacity() const;
+
+    // Heap memory counted in heap_allocations(), for data that would
+    // rather be in an arena but has none
+    static void* heap_allocate(std::size_t bytes);
+
+    static void heap_free(void* p);
+
+    // calls to the heap made by every arena and heap_allocate() so far,
+    // on all threads
+    static long heap_allocations();
+
+    private:
+    struct Block {
+        std::byte* data;
+        std::size_t size;
+    };
+
+    void* allocate_slow(std::size_t bytes, std::size_t align);
+
+    std::vector<Block> blocks;
+    // block being allocated from, and the first free byte in it
+    std::size_t current = 0;
+    std::size_t offset = 0;
+    std::size_t block_size;
+    unsigned gen = 0;
+};
+
+// The calling thread's arena. for_each_tile() rewinds it after every
+// tile, so anything allocated from it during a tile lives until the tile
+// is done, and what was allocated before the tile is left alone.
+Arena& thread_arena();
+
+#endif
@@ -0,0 +1,58 @@
+#include "bounds.h"
+#include <algorithm>
+
+bool Bounds::empty() const {
+    return min.x > max.x || min.y > max.y || min.z > max.z;
+}
+
+Tuple Bounds::centroid() const {
+    return point((min.x + max.x) * 0.5f, (min.y + max.y) * 0.5f, 
+        (min.z + max.z) * 0.5f);
+}
+
+float Bounds::surface_area() const {
+    if (empty()) return 0;
+    float dx = max.x - min.x;
+    float dy = max.y - min.y;
+    float dz = max.z - min.z;
+    return 2 * (dx * dy + dy * dz + dz * dx);
+}
+
+Bounds merge(const Bounds& b, const Tuple& p) {
+    return {point(std::min(b.min.x, p.x), std::min(b.min.y, p.y), std::min(b.min.z, p.z)),
+            point(std::max(b.max.x, p.x), std::max(b.max.y, p.y), std::max(b.max.z, p.z))};
+}
+
+Bounds merge(const Bounds& a, const Bounds& b) {
+    return merge(merge(a, b.min), b.max);
+}
+
+Bounds transform(const Bounds& b, const Mat4& m) {
+    if (b.empty()) return b;
+
+    // the transformed box is bounded by its eight transformed corners
+    Bounds res;
+    for (int i = 0; i < 8; i++) {
+        Tuple corner = point(i & 1 ? b.max.x : b.min.x,
+                             i & 2 ? b.max.y : b.min.y,
+                             i & 4 ? b.max.z : b.min.z);
+        res = merge(res, m * corner);
+    }
+    return res;
+}
+
+bool intersects(const Bounds& b, const Tuple& origin, const Tuple& inv_dir, 
+    float t_max) {
+    float t0x = (b.min.x - origin.x) * inv_dir.x;
+    float t1x = (b.max.x - origin.x) * inv_dir.x;
+    float t0y = (b.min.y - origin.y) * inv_dir.y;
+    float t1y = (b.max.y - origin.y) * inv_dir.y;
+    float t0z = (b.min.z - origin.z) * inv_dir.z;
+    float t1z = (b.max.z - origin.z) * inv_dir.z;
+
+    float t_enter = std::max({std::min(t0x, t1x), std::min(t0y, t1y), 
+        std::min(t0z, t1z), 0.0f});
+    float t_exit = std::min({std::max(t0x, t1x), std::max(t0y, t1y), 
+        std::max(t0z, t1z), t_max});
+    return t_enter <= t_exit;
+}
@@ -0,0 +1,33 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include "tuples.h"
+#include "matrices.h"
+#include "rays.h"
+
+// Axis-aligned bounding box. The default box is empty (min > max),
+// so merging anything into it gives that thing's bounds.
+struct Bounds {
+    Tuple min = point(INFINITY, INFINITY, INFINITY);
+    Tuple max = point(-INFINITY, -INFINITY, -INFINITY);
+
+    bool empty() const;
+
+    Tuple centroid() const;
+
+    float surface_area() const;
+};
+
+Bounds merge(const Bounds& b, const Tuple& p);
+
+Bounds merge(const Bounds& a, const Bounds& b);
+
+// bounds of box b after transforming it by m
+Bounds transform(const Bounds& b, const Mat4& m);
+
+// Slab test. True if the ray is inside the box for some t in [0, t_max];
+// inv_dir holds 1 / direction per axis.
+bool intersects(const Bounds& b, const Tuple& origin, const Tuple& inv_dir, 
+    float t_max);
+
+#endif
@@ -0,0 +1,353 @@
+#include "bvh.h"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+
+namespace {
+    constexpr int bin_count = 16;
+    // cost of visiting a node relative to testing one primitive
+    constexpr float traversal_cost = 0.125f;
+    // keeps the traversal stack of closest_hit() from overflowing
+    constexpr int max_tree_depth = 60;
+
+    float axis_value(const Tuple& t, int axis) {
+        return axis == 0 ? t.x : (axis == 1 ? t.y : t.z);
+    }
+}
+
+double BvhTraversalStats::nodes_per_ray() const {
+    return rays ? static_cast<double>(nodes_visited) / rays : 0;
+}
+
+double BvhTraversalStats::primitives_per_ray() const {
+    return rays ? static_cast<double>(primitives_tested) / rays : 0;
+}
+
+Bvh::Bvh(std::span<const Sphere> spheres, int max_leaf_size)
+: spheres {spheres}, max_leaf_size {std::max(1, max_leaf_size)}
+{
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<BuildItem> items;
+    items.reserve(spheres.size());
+    for (int i = 0; i < static_cast<int>(spheres.size()); i++) {
+        Bounds b = bounds(spheres[i]);
+        items.push_back({b, b.centroid(), i});
+    }
+
+    nodes.reserve(2 * items.size());
+    primitives.reserve(items.size());
+    if (!items.empty()) {
+        build(items, 0, items.size(), 1);
+    }
+
+    inverses.reserve(primitives.size());
+    for (int i : primitives) {
+        inverses.push_back(spheres[i].transform.inverse());
+    }
+
+    build_stats.nodes = nodes.size();
+    build_stats.build_ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+// Builds the subtree for items [begin, end) and returns its node index.
+int Bvh::build(std::vector<BuildItem>& items, int begin, int end, int depth) {
+    int index = nodes.size();
+    nodes.push_back({});
+    build_stats.max_depth = std::max(build_stats.max_depth, depth);
+
+    Bounds node_bounds, centroid_bounds;
+    for (int i = begin; i < end; i++) {
+        node_bounds = merge(node_bounds, items[i].bounds);
+        centroid_bounds = merge(centroid_bounds, items[i].centroid);
+    }
+    nodes[index].bounds = node_bounds;
+
+    int count = end - begin;
+    auto make_leaf = [&] {
+        nodes[index].offset = primitives.size();
+        nodes[index].count = count;
+        nodes[index].axis = 0;
+        for (int i = begin; i < end; i++) {
+            primitives.push_back(items[i].index);
+        }
+        build_stats.leaves++;
+        return index;
+    };
+
+    if (count <= 1 || depth >= max_tree_depth) return make_leaf();
+
+    // binned SAH: try the bin boundaries of every axis and keep the cheapest
+    float best_cost = INFINITY;
+    int best_axis = -1, best_split = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        float lo = axis_value(centroid_bounds.min, axis);
+        float hi = axis_value(centroid_bounds.max, axis);
+        if (hi <= lo) continue;
+
+        Bounds bins[bin_count];
+        int bin_counts[bin_count] = {};
+        float scale = bin_count / (hi - lo);
+        for (int i = begin; i < end; i++) {
+            int b = std::min(bin_count - 1, 
+                static_cast<int>((axis_value(items[i].centroid, axis) - lo) * scale));
+            bins[b] = merge(bins[b], items[i].bounds);
+            bin_counts[b]++;
+        }
+
+        // sweep from the right to get the area and count above each split
+        float right_area[bin_count];
+        int right_count[bin_count];
+        Bounds acc;
+        int n = 0;
+        for (int b = bin_count - 1; b > 0; b--) {
+            acc = merge(acc, bins[b]);
+            n += bin_counts[b];
+            right_area[b] = acc.surface_area();
+            right_count[b] = n;
+        }
+
+        acc = Bounds {};
+        n = 0;
+        for (int b = 0; b < bin_count - 1; b++) {
+            acc = merge(acc, bins[b]);
+            n += bin_counts[b];
+            if (n == 0 || right_count[b + 1] == 0) continue;
+            float cost = traversal_cost + (acc.surface_area() * n 
+                + right_area[b + 1] * right_count[b + 1]) / node_bounds.surface_area();
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = b;
+            }
+        }
+    }
+
+    // a leaf is cheaper, or all centroids coincide
+    if (best_axis < 0 || (count <= max_leaf_size && best_cost >= count)) {
+        return make_leaf();
+    }
+
+    float lo = axis_value(centroid_bounds.min, best_axis);
+    float scale = bin_count / (axis_value(centroid_bounds.max, best_axis) - lo);
+    BuildItem* mid = std::partition(items.data() + begin, items.data() + end,
+        [&](const BuildItem& item) {
+            int b = std::min(bin_count - 1, 
+                static_cast<int>((axis_value(item.centroid, best_axis) - lo) * scale));
+            return b <= best_split;
+        });
+    int split = mid - items.data();
+
+    build(items, begin, split, depth + 1);
+    int right = build(items, split, end, depth + 1);
+    nodes[index].offset = right;
+    nodes[index].count = 0;
+    nodes[index].axis = best_axis;
+    return index;
+}
+
+std::optional<Intersection> Bvh::closest_hit(const Ray& r, 
+    BvhTraversalStats* stats) const {
+    if (nodes.empty()) return std::nullopt;
+
+    Tuple inv_dir = vector(1 / r.direction.x, 1 / r.direction.y, 1 / r.direction.z);
+    bool dir_negative[3] = {inv_dir.x < 0, inv_dir.y < 0, inv_dir.z < 0};
+
+    float best_t = INFINITY;
+    int best = -1;
+    long visited = 0, tested = 0;
+
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const BvhNode& node = nodes[stack[--top]];
+        visited++;
+        if (!intersects(node.bounds, r.origin, inv_dir, best_t)) continue;
+
+        if (node.count > 0) {
+            for (int i = node.offset; i < node.offset + node.count; i++) {
+                tested++;
+                float t = closest_t(inverses[i], r);
+                if (t >= 0 && t < best_t) {
+                    best_t = t;
+                    best = i;
+                }
+            }
+        } else {
+            // visit the child nearer to the ray origin first
+            int left = &node - nodes.data() + 1;
+            if (dir_negative[node.axis]) {
+                stack[top++] = left;
+                stack[top++] = node.offset;
+            } else {
+                stack[top++] = node.offset;
+                stack[top++] = left;
+            }
+        }
+    }
+
+    if (stats) {
+        stats->rays++;
+        stats->hits += best >= 0;
+        stats->nodes_visited += visited;
+        stats->primitives_tested += tested;
+    }
+    if (best < 0) return std::nullopt;
+    return Intersection {best_t, &spheres[primitives[best]]};
+}
+
+// Same walk as closest_hit(), but the first hit below t_max ends it and
+// the interval never shrinks.
+bool Bvh::any_hit(const Ray& r, float t_max, BvhTraversalStats* stats) const {
+    Tuple inv_dir = vector(1 / r.direction.x, 1 / r.direction.y, 1 / r.direction.z);
+    bool dir_negative[3] = {inv_dir.x < 0, inv_dir.y < 0, inv_dir.z < 0};
+    bool found = false;
+    long visited = 0, tested = 0;
+
+    int stack[64];
+    int top = 0;
+    if (!nodes.empty()) stack[top++] = 0;
+    while (top > 0 && !found) {
+        const BvhNode& node = nodes[stack[--top]];
+        visited++;
+        if (!intersects(node.bounds, r.origin, inv_dir, t_max)) continue;
+
+        if (node.count > 0) {
+            for (int i = node.offset; i < node.offset + node.count; i++) {
+                tested++;
+                float t = closest_t(inverses[i], r);
+                if (t >= 0 && t < t_max) {
+                    found = true;
+                    break;
+                }
+            }
+        } else {
+            int left = &node - nodes.data() + 1;
+            if (dir_negative[node.axis]) {
+                stack[top++] = left;
+                stack[top++] = node.offset;
+            } else {
+                stack[top++] = node.offset;
+                stack[top++] = left;
+            }
+        }
+    }
+
+    if (stats) {
+        stats->rays++;
+        stats->hits += found;
+        stats->nodes_visited += visited;
+        stats->primitives_tested += tested;
+    }
+    return found;
+}
+
+void Bvh::any_hit(const RayPacket& rays, float t_max, std::span<char> hit,
+    BvhTraversalStats* stats) const {
+    for (int first = 0; first < rays.size(); first += shadow_packet_size) {
+        int n = std::min(shadow_packet_size, rays.size() - first);
+        any_hit_packet(rays, first, n, t_max, hit.data() + first, stats);
+    }
+}
+
+// Each stack entry carries the mask of rays that reached the node's
+// parent and are not blocked yet. A node is tested against those rays
+// only, and the walk stops once every ray is blocked.
+void Bvh::any_hit_packet(const RayPacket& rays, int first, int n, float t_max,
+    char* hit, BvhTraversalStats* stats) const {
+    Tuple origin[64];
+    Tuple inv_dir[64];
+    Ray ray[64];
+    for (int k = 0; k < n; k++) {
+        int i = first + k;
+        ray[k] = rays.at(i);
+        origin[k] = ray[k].origin;
+        inv_dir[k] = vector(1 / rays.dx[i], 1 / rays.dy[i], 1 / rays.dz[i]);
+        hit[k] = 0;
+    }
+    const std::uint64_t all = n == 64 ? ~std::uint64_t {0} : (std::uint64_t {1} << n) - 1;
+    std::uint64_t blocked = 0;
+    long visited = 0, tested = 0;
+
+    struct Entry {
+        int node;
+        std::uint64_t mask;
+    };
+    Entry stack[64];
+    int top = 0;
+    if (!nodes.empty()) stack[top++] = {0, all};
+    while (top > 0 && blocked != all) {
+        Entry e = stack[--top];
+        const BvhNode& node = nodes[e.node];
+
+        std::uint64_t active = 0;
+        for (std::uint64_t m = e.mask & ~blocked; m; m &= m - 1) {
+            int k = std::countr_zero(m);
+            visited++;
+            if (intersects(node.bounds, origin[k], inv_dir[k], t_max)) {
+                active |= std::uint64_t {1} << k;
+            }
+        }
+        if (!active) continue;
+
+        if (node.count > 0) {
+            for (int i = node.offset; i < node.offset + node.count && active; i++) {
+                for (std::uint64_t m = active; m; m &= m - 1) {
+                    int k = std::countr_zero(m);
+                    tested++;
+                    float t = closest_t(inverses[i], ray[k]);
+                    if (t >= 0 && t < t_max) {
+                        blocked |= std::uint64_t {1} << k;
+                        active &= ~(std::uint64_t {1} << k);
+                    }
+                }
+            }
+        } else {
+            // order by the first active ray; the others mostly agree
+            int left = e.node + 1;
+            int k = std::countr_zero(active);
+            float d = node.axis == 0 ? rays.dx[first + k]
+                : (node.axis == 1 ? rays.dy[first + k] : rays.dz[first + k]);
+            if (d < 0) {
+                stack[top++] = {left, active};
+                stack[top++] = {node.offset, active};
+            } else {
+                stack[top++] = {node.offset, active};
+                stack[top++] = {left, active};
+            }
+        }
+    }
+
+    for (std::uint64_t m = blocked; m; m &= m - 1) {
+        hit[std::countr_zero(m)] = 1;
+    }
+    if (stats) {
+        stats->rays += n;
+        stats->hits += std::popcount(blocked);
+        stats->nodes_visited += visited;
+        stats->primitives_tested += tested;
+    }
+}
+
+// The shadow ray goes straight to the light without being normalized,
+// so the light is at t = 1 and anything blocking it has t < 1.
+bool Bvh::is_occluded(const Tuple& point, const PointLight& light,
+    BvhTraversalStats* stats) const {
+    return any_hit(Ray {point, light.position - point}, 1, stats);
+}
+
+void Bvh::is_occluded(std::span<const Tuple> points, const PointLight& light,
+    std::span<char> occluded, BvhTraversalStats* stats) const {
+    thread_local RayPacket packet;
+    for (std::size_t first = 0; first < points.size(); first += shadow_packet_size) {
+        std::size_t n = std::min<std::size_t>(shadow_packet_size, points.size() - first);
+        packet.clear();
+        for (std::size_t i = first; i < first + n; i++) {
+            packet.push_back({points[i], light.position - points[i]});
+        }
+        any_hit_packet(packet, 0, n, 1, occluded.data() + first, stats);
+    }
+}
@@ -0,0 +1,107 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <optional>
+#include <span>
+#include <vector>
+#include "bounds.h"
+#include "spheres.h"
+#include "intersections.h"
+#include "lights.h"
+
+// Node of a flattened BVH. Nodes are stored depth first, so the left
+// child of an interior node is always the next node.
+struct BvhNode {
+    Bounds bounds;
+    // leaf: index of its first primitive in Bvh::primitives,
+    // interior: index of the right child
+    int offset;
+    // number of primitives, 0 for interior nodes
+    int count;
+    // axis the node was split along (0 = x, 1 = y, 2 = z)
+    int axis;
+};
+
+struct BvhBuildStats {
+    double build_ms = 0;
+    int nodes = 0;
+    int leaves = 0;
+    int max_depth = 0;
+};
+
+// Accumulated by the queries below when passed in; not thread safe, so
+// use one per thread and add them up.
+struct BvhTraversalStats {
+    long rays = 0;
+    // rays that hit something: found a closest hit, or were blocked
+    long hits = 0;
+    long nodes_visited = 0;
+    long primitives_tested = 0;
+
+    double nodes_per_ray() const;
+
+    double primitives_per_ray() const;
+};
+
+// Bounding volume hierarchy over spheres, built with the surface area
+// heuristic. The spheres must outlive the Bvh and keep their transforms.
+class Bvh {
+    public:
+    explicit Bvh(std::span<const Sphere> spheres, int max_leaf_size = 4);
+
+    // closest intersection with t >= 0
+    std::optional<Intersection> closest_hit(const Ray& r, 
+        BvhTraversalStats* stats = nullptr) const;
+
+    // True if r hits anything with 0 <= t < t_max. Stops at the first
+    // such hit found, in whatever order, so it is cheaper than
+    // closest_hit() when only a yes or no is needed.
+    bool any_hit(const Ray& r, float t_max, BvhTraversalStats* stats = nullptr) const;
+
+    // Any-hit for every ray of the packet at once. The packet walks the
+    // tree together, so each node is fetched once for all the rays that
+    // reach it, and rays drop out as soon as they are blocked.
+    // hit must hold rays.size() elements.
+    void any_hit(const RayPacket& rays, float t_max, std::span<char> hit,
+        BvhTraversalStats* stats = nullptr) const;
+
+    // Shadow test: true if anything lies between point and the light.
+    // Pass a point nudged off the surface along its normal, or the
+    // surface may shadow itself.
+    bool is_occluded(const Tuple& point, const PointLight& light,
+        BvhTraversalStats* stats = nullptr) const;
+
+    // Shadow test for many points, in packets of shadow_packet_size.
+    // occluded must hold points.size() elements.
+    void is_occluded(std::span<const Tuple> points, const PointLight& light,
+        std::span<char> occluded, BvhTraversalStats* stats = nullptr) const;
+
+    // rays walking the tree together in the packet queries; one bit each
+    // in a 64-bit mask
+    static constexpr int shadow_packet_size = 64;
+
+    std::vector<BvhNode> nodes;
+    // sphere indices in leaf order
+    std::vector<int> primitives;
+    BvhBuildStats build_stats;
+
+    private:
+    struct BuildItem {
+        Bounds bounds;
+        Tuple centroid;
+        int index;
+    };
+
+    int build(std::vector<BuildItem>& items, int begin, int end, int depth);
+
+    // any_hit() on n <= shadow_packet_size rays of the packet, from first
+    void any_hit_packet(const RayPacket& rays, int first, int n, float t_max,
+        char* hit, BvhTraversalStats* stats) const;
+
+    std::span<const Sphere> spheres;
+    // inverse transforms in leaf order, next to each other for traversal
+    std::vector<Mat4> inverses;
+    int max_leaf_size;
+};
+
+#endif
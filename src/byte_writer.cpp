@@ -0,0 +1,62 @@
+#include "byte_writer.h"
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <unistd.h>
+
+ByteWriter::ByteWriter(std::ostream& out) : stream {&out}
+{
+}
+
+ByteWriter::ByteWriter(int fd) : fd {fd}
+{
+}
+
+ByteWriter::~ByteWriter() {
+    try {
+        flush();
+    } catch (...) {
+        // destructors must not throw; call flush() to see errors
+    }
+}
+
+void ByteWriter::write(const void* data, std::size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    if (used + size <= capacity) {
+        std::memcpy(buffer + used, bytes, size);
+        used += size;
+        return;
+    }
+    flush();
+    if (size < capacity) {
+        std::memcpy(buffer, bytes, size);
+        used = size;
+    } else {
+        send(bytes, size);
+    }
+}
+
+void ByteWriter::flush() {
+    std::size_t n = used;
+    used = 0;
+    send(buffer, n);
+}
+
+void ByteWriter::send(const char* data, std::size_t size) {
+    if (size == 0) return;
+
+    if (stream) {
+        stream->write(data, size);
+        return;
+    }
+    std::size_t done = 0;
+    while (done < size) {
+        ssize_t n = ::write(fd, data + done, size - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::system_error(errno, std::generic_category(), 
+                "writing image data");
+        }
+        done += n;
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef BYTE_WRITER_H
+#define BYTE_WRITER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+// Buffered binary output to a stream or file descriptor, shared by the
+// image encoders. Big writes skip the buffer.
+class ByteWriter {
+    public:
+    explicit ByteWriter(std::ostream& out);
+
+    explicit ByteWriter(int fd);
+
+    ByteWriter(const ByteWriter&) = delete;
+
+    ByteWriter& operator=(const ByteWriter&) = delete;
+
+    // flushes whatever is still buffered
+    ~ByteWriter();
+
+    void put(std::uint8_t byte) {
+        if (used == capacity) flush();
+        buffer[used++] = static_cast<char>(byte);
+    }
+
+    // big-endian, as PNG and QOI store their integers
+    void put_u32(std::uint32_t v) {
+        put(v >> 24);
+        put(v >> 16);
+        put(v >> 8);
+        put(v);
+    }
+
+    void write(const void* data, std::size_t size);
+
+    // sends the buffer to the stream / fd.
+    // Throws std::system_error if writing to the fd fails.
+    void flush();
+
+    private:
+    static constexpr std::size_t capacity = 64 * 1024;
+
+    void send(const char* data, std::size_t size);
+
+    std::ostream* stream = nullptr;
+    int fd = -1;
+    std::size_t used = 0;
+    char buffer[capacity];
+};
+
+#endif
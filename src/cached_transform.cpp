@@ -0,0 +1,81 @@
+#include "cached_transform.h"
+#include <thread>
+
+CachedTransform::CachedTransform(const Mat4& m) : m {m} 
+{
+}
+
+CachedTransform::CachedTransform(const CachedTransform& other) : m {other.m} 
+{
+    if (other.cached()) {
+        inv = other.inv;
+        inv_t = other.inv_t;
+        state = ready;
+    }
+}
+
+CachedTransform& CachedTransform::operator=(const CachedTransform& other) {
+    m = other.m;
+    if (other.cached()) {
+        inv = other.inv;
+        inv_t = other.inv_t;
+        state = ready;
+    } else {
+        state = stale;
+    }
+    return *this;
+}
+
+CachedTransform& CachedTransform::operator=(const Mat4& m) {
+    set(m);
+    return *this;
+}
+
+void CachedTransform::set(const Mat4& matrix) {
+    m = matrix;
+    state.store(stale, std::memory_order_release);
+}
+
+void CachedTransform::set(const Mat4& matrix, const Mat4& inverse) {
+    m = matrix;
+    inv = inverse;
+    inv_t = transpose(inverse);
+    state.store(ready, std::memory_order_release);
+}
+
+const Mat4& CachedTransform::matrix() const {
+    return m;
+}
+
+CachedTransform::operator const Mat4&() const {
+    return m;
+}
+
+const Mat4& CachedTransform::inverse() const {
+    if (state.load(std::memory_order_acquire) != ready) update();
+    return inv;
+}
+
+const Mat4& CachedTransform::inverse_transpose() const {
+    if (state.load(std::memory_order_acquire) != ready) update();
+    return inv_t;
+}
+
+bool CachedTransform::cached() const {
+    return state.load(std::memory_order_acquire) == ready;
+}
+
+// The first thread to get here computes, any others wait for it.
+void CachedTransform::update() const {
+    int expected = stale;
+    if (state.compare_exchange_strong(expected, computing, 
+            std::memory_order_acquire)) {
+        inv = ::inverse(m);
+        inv_t = transpose(inv);
+        state.store(ready, std::memory_order_release);
+    } else {
+        while (state.load(std::memory_order_acquire) != ready) {
+            std::this_thread::yield();
+        }
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef CACHED_TRANSFORM_H
+#define CACHED_TRANSFORM_H
+
+#include <atomic>
+#include "matrices.h"
+
+// Transformation matrix that keeps its inverse and inverse-transpose.
+// Both are computed on first use after the matrix is set and then reused,
+// so rays only pay for a matrix-tuple multiply.
+// Reading from several threads at once is safe; setting the matrix while
+// other threads read it is not.
+class CachedTransform {
+    public:
+    CachedTransform(const Mat4& m = matrices::identity4);
+
+    CachedTransform(const CachedTransform& other);
+
+    CachedTransform& operator=(const CachedTransform& other);
+
+    CachedTransform& operator=(const Mat4& m);
+
+    void set(const Mat4& m);
+
+    // when the caller already knows the inverse
+    void set(const Mat4& m, const Mat4& inverse);
+
+    const Mat4& matrix() const;
+
+    operator const Mat4&() const;
+
+    const Mat4& inverse() const;
+
+    // for transforming normals back to world space
+    const Mat4& inverse_transpose() const;
+
+    // true once the inverse has been computed for the current matrix
+    bool cached() const;
+
+    private:
+    enum State { stale, computing, ready };
+
+    void update() const;
+
+    Mat4 m;
+    mutable Mat4 inv;
+    mutable Mat4 inv_t;
+    mutable std::atomic<int> state {stale};
+};
+
+#endif
@@ -0,0 +1,100 @@
+#include "camera.h"
+#include <algorithm>
+#include <cmath>
+#include "trace.h"
+#include "transformations.h"
+
+Mat4 view_transform(const Tuple& from, const Tuple& to, const Tuple& up) {
+    Tuple forward = normalize(to - from);
+    Tuple left = cross(forward, normalize(up));
+    Tuple true_up = cross(left, forward);
+    Mat4 orientation = {{{left.x, left.y, left.z, 0},
+                         {true_up.x, true_up.y, true_up.z, 0},
+                         {-forward.x, -forward.y, -forward.z, 0},
+                         {0, 0, 0, 1}}};
+    return orientation * translation(-from.x, -from.y, -from.z);
+}
+
+Camera::Camera(int hsize, int vsize, float field_of_view, const Mat4& transform)
+    : h {hsize}, v {vsize}, fov {field_of_view}, m {transform} {
+    float half_view = std::tan(fov / 2);
+    float aspect = static_cast<float>(h) / v;
+    float half_width = aspect >= 1 ? half_view : half_view * aspect;
+    float half_height = aspect >= 1 ? half_view / aspect : half_view;
+    size = half_width * 2 / h;
+
+    // the camera looks toward -z, so +x on the canvas is to the left
+    x_offsets.resize(h);
+    for (int px = 0; px < h; px++) {
+        x_offsets[px] = half_width - (px + 0.5f) * size;
+    }
+    y_offsets.resize(v);
+    for (int py = 0; py < v; py++) {
+        y_offsets[py] = half_height - (py + 0.5f) * size;
+    }
+
+    std::size_t pixels = static_cast<std::size_t>(h) * v;
+    dx.resize(pixels);
+    dy.resize(pixels);
+    dz.resize(pixels);
+    update_directions();
+}
+
+void Camera::set_transform(const Mat4& transform) {
+    m.set(transform);
+    update_directions();
+}
+
+void Camera::set_transform(const Mat4& transform, const Mat4& inverse) {
+    m.set(transform, inverse);
+    update_directions();
+}
+
+// The canvas point of a pixel is (x, y, -1) in camera space and the eye
+// is at the origin, so the direction is the linear part of the inverse
+// transform applied to (x, y, -1). Plain loops over arrays, so they
+// vectorize.
+void Camera::update_directions() {
+    TRACE_SCOPE("Camera::update_directions");
+    const Mat4& inv = m.inverse();
+    origin = inv * point(0, 0, 0);
+    updates++;
+
+    for (int py = 0; py < v; py++) {
+        float y = y_offsets[py];
+        // the terms that are the same along the row
+        float bx = inv[0][1] * y - inv[0][2];
+        float by = inv[1][1] * y - inv[1][2];
+        float bz = inv[2][1] * y - inv[2][2];
+        std::size_t row = static_cast<std::size_t>(py) * h;
+        float* rx = dx.data() + row;
+        float* ry = dy.data() + row;
+        float* rz = dz.data() + row;
+        for (int px = 0; px < h; px++) {
+            float x = x_offsets[px];
+            float wx = inv[0][0] * x + bx;
+            float wy = inv[1][0] * x + by;
+            float wz = inv[2][0] * x + bz;
+            float scale = 1 / std::sqrt(wx * wx + wy * wy + wz * wz);
+            rx[px] = wx * scale;
+            ry[px] = wy * scale;
+            rz[px] = wz * scale;
+        }
+    }
+}
+
+void Camera::rays_for_tile(const Tile& t, RayPacket& rays) const {
+    int width = t.x1 - t.x0;
+    rays.resize(width * (t.y1 - t.y0));
+
+    std::fill(rays.ox.begin(), rays.ox.end(), origin.x);
+    std::fill(rays.oy.begin(), rays.oy.end(), origin.y);
+    std::fill(rays.oz.begin(), rays.oz.end(), origin.z);
+    for (int y = t.y0; y < t.y1; y++) {
+        std::size_t from = static_cast<std::size_t>(y) * h + t.x0;
+        std::size_t to = static_cast<std::size_t>(y - t.y0) * width;
+        std::copy_n(dx.data() + from, width, rays.dx.data() + to);
+        std::copy_n(dy.data() + from, width, rays.dy.data() + to);
+        std::copy_n(dz.data() + from, width, rays.dz.data() + to);
+    }
+}
@@ -0,0 +1,103 @@
+#ifndef CAMERA_H
+#define CAMERA_H
+
+#include <stdexcept>
+#include <vector>
+#include "cached_transform.h"
+#include "matrices.h"
+#include "rays.h"
+#include "render.h"
+
+// Transformation that puts the eye at from, looking at to, with up
+// roughly pointing up. The result is a camera's transform.
+Mat4 view_transform(const Tuple& from, const Tuple& to, const Tuple& up);
+
+// Pinhole camera one unit in front of a hsize x vsize canvas.
+//
+// The offset of every pixel column and row on the canvas is computed
+// once, and the world-space direction through every pixel is kept in one
+// contiguous buffer. The buffer only changes when the transform does, so
+// a still camera renders every frame without any matrix math, and a
+// moving one pays for one pass over the buffer per frame instead of an
+// inverse transform per pixel.
+class Camera {
+    public:
+    Camera(int hsize, int vsize, float field_of_view,
+        const Mat4& transform = matrices::identity4);
+
+    int hsize() const { return h; }
+
+    int vsize() const { return v; }
+
+    float field_of_view() const { return fov; }
+
+    // width of a pixel on the canvas, in world units
+    float pixel_size() const { return size; }
+
+    const Mat4& transform() const { return m.matrix(); }
+
+    // Recomputes the cached directions. Not safe while other threads are
+    // generating rays.
+    void set_transform(const Mat4& transform);
+
+    // when the caller already knows the inverse, e.g. from
+    // Scene::world_inverse()
+    void set_transform(const Mat4& transform, const Mat4& inverse);
+
+    // number of times the cached directions were computed
+    long direction_updates() const { return updates; }
+
+    // ray through the center of pixel (px, py)
+    Ray ray_for_pixel(int px, int py) const {
+        std::size_t i = static_cast<std::size_t>(py) * h + px;
+        return {origin, vector(dx[i], dy[i], dz[i])};
+    }
+
+    // Rays through every pixel of t, row by row, replacing what was in
+    // rays. Reuse the packet so its storage is not reallocated.
+    void rays_for_tile(const Tile& t, RayPacket& rays) const;
+
+    private:
+    void update_directions();
+
+    int h;
+    int v;
+    float fov;
+    float size;
+    CachedTransform m;
+    // eye position in world space
+    Tuple origin;
+    // canvas coordinates of the pixel centers, per column and per row
+    std::vector<float> x_offsets;
+    std::vector<float> y_offsets;
+    // world-space unit directions, hsize * vsize, row-major
+    std::vector<float> dx, dy, dz;
+    long updates = 0;
+};
+
+// Renders canvas, which must be hsize x vsize, through camera.
+// shade(ray) gives the color of the pixel the ray goes through and must
+// be safe to call from several threads. Rays come from
+// Camera::rays_for_tile(), a tile at a time.
+// Throws std::invalid_argument if the sizes do not match.
+template <typename Pixel, typename Shader>
+void render(BasicCanvas<Pixel>& canvas, const Camera& camera, Shader&& shade,
+    RenderOptions options = {}) {
+    if (canvas.width != camera.hsize() || canvas.height != camera.vsize()) {
+        throw std::invalid_argument("canvas and camera sizes differ");
+    }
+    for_each_tile(canvas.width, canvas.height, [&](const Tile& t) {
+        thread_local RayPacket rays;
+        camera.rays_for_tile(t, rays);
+        int i = 0;
+        for (int y = t.y0; y < t.y1; y++) {
+            std::span<Pixel> row = canvas.row(y);
+            for (int x = t.x0; x < t.x1; x++) {
+                row[x] = PixelFormat<Pixel>::encode(shade(rays.at(i++)));
+            }
+        }
+        TRACE_COUNT(pixels_written, (t.x1 - t.x0) * (t.y1 - t.y0));
+    }, options);
+}
+
+#endif
@@ -1,63 +1,74 @@
 #include "canvas.h"
+#include <sstream>
 
-Canvas::Canvas(int w, int h) : width {w}, height {h} 
+template <typename Pixel>
+BasicCanvas<Pixel>::BasicCanvas(int w, int h) : width {w}, height {h} 
 {
-    pixels = std::vector<std::vector<Tuple>> (w, 
-        std::vector<Tuple>(h, color(0, 0, 0)));
+    pixels = std::vector<Pixel> (static_cast<size_t>(w) * h, 
+        PixelFormat<Pixel>::encode(color(0, 0, 0)));
 }
 
-Canvas::Canvas(int w, int h, Tuple color)
+template <typename Pixel>
+BasicCanvas<Pixel>::BasicCanvas(int w, int h, Tuple color)
 : width {w}, height {h}
 {
-    pixels = std::vector<std::vector<Tuple>> (w, 
-        std::vector<Tuple>(h, color));
+    pixels = std::vector<Pixel> (static_cast<size_t>(w) * h, 
+        PixelFormat<Pixel>::encode(color));
 }
 
-void Canvas::write_pixel(int x, int y, Tuple color) {
-    pixels[x][y] = color;
+template <typename Pixel>
+std::span<Pixel> BasicCanvas<Pixel>::row(int y) {
+    return {pixels.data() + static_cast<size_t>(y) * width, 
+        static_cast<size_t>(width)};
 }
 
-Tuple Canvas::pixel_at(int x, int y) {
-    return pixels[x][y];
+template <typename Pixel>
+std::span<const Pixel> BasicCanvas<Pixel>::row(int y) const {
+    return {pixels.data() + static_cast<size_t>(y) * width, 
+        static_cast<size_t>(width)};
 }
 
-std::string Canvas::to_ppm() {
-    // append header
-    std::string s_out {"P3\n" + std::to_string(width) 
-        + " " + std::to_string(height) + "\n255\n"};
-
-    // append pixel data
-    for (int i = 0; i < height; i++) {
-        std::string row {};
-        for (int j = 0; j < width; j++) {
-            // interpolation 0-1 to 0-255
-            int r = std::clamp(
-                static_cast<int>((pixels[j][i].x * 255) + 0.5), 0, 255);
-            int g = std::clamp(
-                static_cast<int>((pixels[j][i].y * 255) + 0.5), 0, 255);
-            int b = std::clamp(
-                static_cast<int>((pixels[j][i].z * 255) + 0.5), 0, 255);
+template <typename Pixel>
+std::span<Pixel> BasicCanvas<Pixel>::data() {
+    return pixels;
+}
 
-            row.append(std::to_string(r) + " ");
-            // limit row to 70 characters
-            limitString(row, s_out);
+template <typename Pixel>
+std::span<const Pixel> BasicCanvas<Pixel>::data() const {
+    return pixels;
+}
 
-            row.append(std::to_string(g) + " ");
-            limitString(row, s_out);
+template <typename Pixel>
+std::string BasicCanvas<Pixel>::to_ppm() const {
+    TRACE_SCOPE("to_ppm");
+    std::ostringstream out;
+    write_ppm(out, PpmFormat::P3);
+    return out.str();
+}
 
-            row.append(std::to_string(b) + " ");
-            limitString(row, s_out);
-        }
-        row[row.length() - 1] = '\n';
-        s_out.append(row);
+template <typename Pixel>
+void BasicCanvas<Pixel>::write_ppm(std::ostream& out, PpmFormat format) const {
+    TRACE_SCOPE("write_ppm");
+    PpmWriter writer {out, format};
+    writer.write_header(width, height);
+    for (int y = 0; y < height; y++) {
+        writer.write_row(row(y));
     }
-    return s_out;
+    writer.flush();
 }
 
-void Canvas::limitString(std::string& row, std::string& out) {
-    if (row.length() > 70) {
-        row[row.rfind(" ", row.length() - 2)] = '\n';
-        out.append(row);
-        row = "";
+template <typename Pixel>
+void BasicCanvas<Pixel>::write_ppm(int fd, PpmFormat format) const {
+    TRACE_SCOPE("write_ppm");
+    PpmWriter writer {fd, format};
+    writer.write_header(width, height);
+    for (int y = 0; y < height; y++) {
+        writer.write_row(row(y));
     }
-}
\ No newline at end of file
+    writer.flush();
+}
+
+template class BasicCanvas<Tuple>;
+template class BasicCanvas<Rgb8>;
+template class BasicCanvas<Rgb16f>;
+template class BasicCanvas<Rgb32f>;
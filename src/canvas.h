@@ -4,28 +4,69 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <span>
+#include <ostream>
 #include "tuples.h"
+#include "pixels.h"
+#include "ppm.h"
+#include "trace.h"
 
-class Canvas {
+// Image stored as Pixel values (see pixels.h). Colors are converted to
+// the storage format by write_pixel() and back by pixel_at(); row() and
+// data() give the stored pixels themselves.
+// Instantiated for Tuple, Rgb8, Rgb16f and Rgb32f in canvas.cpp.
+template <typename Pixel>
+class BasicCanvas {
     private:
-    std::vector<std::vector<Tuple>> pixels;
+    // one contiguous block, row-major: pixel (x, y) is at y * width + x
+    std::vector<Pixel> pixels;
 
     public:
     int width;
     int height;
 
-    Canvas(int w, int h);
+    BasicCanvas(int w, int h);
 
-    Canvas(int w, int h, Tuple color);
+    BasicCanvas(int w, int h, Tuple color);
 
-    void write_pixel(int x, int y, Tuple color);
+    void write_pixel(int x, int y, Tuple color) {
+        TRACE_COUNT(pixels_written, 1);
+        pixels[static_cast<size_t>(y) * width + x] = PixelFormat<Pixel>::encode(color);
+    }
 
-    Tuple pixel_at(int x, int y);
+    Tuple pixel_at(int x, int y) const {
+        return PixelFormat<Pixel>::decode(pixels[static_cast<size_t>(y) * width + x]);
+    }
 
-    std::string to_ppm();
+    // pixels of row y, left to right
+    std::span<Pixel> row(int y);
 
-    private:
-    void limitString(std::string& row, std::string& out);
+    std::span<const Pixel> row(int y) const;
+
+    // every pixel, row after row
+    std::span<Pixel> data();
+
+    std::span<const Pixel> data() const;
+
+    // whole image as an ASCII (P3) PPM string
+    std::string to_ppm() const;
+
+    // streams the image row by row; memory used does not grow with the image
+    void write_ppm(std::ostream& out, PpmFormat format = PpmFormat::P3) const;
+
+    void write_ppm(int fd, PpmFormat format = PpmFormat::P3) const;
 };
 
-#endif
\ No newline at end of file
+// full float colors, 16 bytes per pixel
+using Canvas = BasicCanvas<Tuple>;
+
+using Rgb8Canvas = BasicCanvas<Rgb8>;
+using Rgb16fCanvas = BasicCanvas<Rgb16f>;
+using Rgb32fCanvas = BasicCanvas<Rgb32f>;
+
+extern template class BasicCanvas<Tuple>;
+extern template class BasicCanvas<Rgb8>;
+extern template class BasicCanvas<Rgb16f>;
+extern template class BasicCanvas<Rgb32f>;
+
+#endif
@@ -0,0 +1,11 @@
+#include "cpu.h"
+
+bool cpu_has_avx2() {
+#ifdef RAY_TRACER_AVX2
+    static const bool supported = __builtin_cpu_supports("avx2")
+        && __builtin_cpu_supports("fma");
+    return supported;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,16 @@
+#ifndef CPU_H
+#define CPU_H
+
+// RAY_TRACER_AVX2 is defined where AVX2 kernels can be built: GCC or Clang
+// on x86, unless RAY_TRACER_NO_SIMD is defined. Such kernels are compiled
+// with __attribute__((target("avx2,fma"))) whatever the build flags, and
+// must only be called when cpu_has_avx2() says the CPU can run them.
+#if !defined(RAY_TRACER_NO_SIMD) && (defined(__GNUC__) || defined(__clang__)) \
+    && (defined(__x86_64__) || defined(__i386__))
+#define RAY_TRACER_AVX2 1
+#endif
+
+// true when RAY_TRACER_AVX2 is defined and this CPU has AVX2 and FMA
+bool cpu_has_avx2();
+
+#endif
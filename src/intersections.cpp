@@ -0,0 +1,55 @@
+#include "intersections.h"
+#include <algorithm>
+
+const Intersection* hit(std::span<const Intersection> xs) {
+    const Intersection* best = nullptr;
+    for (const Intersection& i : xs) {
+        if (i.t >= 0 && (!best || i.t < best->t)) {
+            best = &i;
+        }
+    }
+    return best;
+}
+
+void sort_intersections(std::span<Intersection> xs) {
+    std::sort(xs.begin(), xs.end(), 
+        [](const Intersection& a, const Intersection& b) { return a.t < b.t; });
+}
+
+Intersections::Intersections(std::initializer_list<Intersection> xs) : arena {nullptr} {
+    for (const Intersection& x : xs) push_back(x);
+}
+
+Intersections::Intersections(const Intersections& other) : arena {other.arena} {
+    for (const Intersection& x : other) push_back(x);
+}
+
+Intersections& Intersections::operator=(const Intersections& other) {
+    if (this != &other) {
+        clear();
+        for (const Intersection& x : other) push_back(x);
+    }
+    return *this;
+}
+
+Intersections::~Intersections() {
+    if (!arena && items != local) Arena::heap_free(items);
+}
+
+// Doubles the capacity. Arena storage is left behind for the next reset
+// to take back; heap storage is freed.
+void Intersections::grow(std::size_t needed) {
+    std::size_t new_cap = std::max(needed, cap * 2);
+    Intersection* bigger;
+    if (arena) {
+        bigger = arena->allocate<Intersection>(new_cap);
+        generation = arena->generation();
+    } else {
+        bigger = static_cast<Intersection*>(
+            Arena::heap_allocate(new_cap * sizeof(Intersection)));
+    }
+    std::copy(items, items + count, bigger);
+    if (!arena && items != local) Arena::heap_free(items);
+    items = bigger;
+    cap = new_cap;
+}
@@ -0,0 +1,96 @@
+#ifndef INTERSECTIONS_H
+#define INTERSECTIONS_H
+
+#include <cstddef>
+#include <initializer_list>
+#include <span>
+#include "arena.h"
+
+struct Sphere;
+
+struct Intersection {
+    float t;
+    const Sphere* object;
+};
+
+// Intersection routines append to a list owned by the caller, so the
+// same storage can be cleared and reused for every ray.
+//
+// The first inline_capacity intersections are stored in the list itself.
+// Longer lists spill into the arena they were given, or onto the heap
+// (counted by Arena::heap_allocations()) if they have none, so a ray
+// normally costs no allocation at all.
+// A list that spilled into an arena must be cleared or destroyed when the
+// arena is reset; clear() notices the reset and goes back to the inline
+// storage.
+class Intersections {
+    public:
+    static constexpr int inline_capacity = 8;
+
+    explicit Intersections(Arena* arena = nullptr) : arena {arena} {}
+
+    Intersections(std::initializer_list<Intersection> xs);
+
+    Intersections(const Intersections& other);
+
+    Intersections& operator=(const Intersections& other);
+
+    ~Intersections();
+
+    void push_back(const Intersection& x) {
+        if (count == cap) grow(count + 1);
+        items[count++] = x;
+    }
+
+    void clear() {
+        count = 0;
+        if (arena && items != local && arena->generation() != generation) {
+            items = local;
+            cap = inline_capacity;
+        }
+    }
+
+    std::size_t size() const { return count; }
+
+    bool empty() const { return count == 0; }
+
+    std::size_t capacity() const { return cap; }
+
+    // true once the list has outgrown its inline storage
+    bool spilled() const { return items != local; }
+
+    Intersection* data() { return items; }
+
+    const Intersection* data() const { return items; }
+
+    Intersection* begin() { return items; }
+
+    Intersection* end() { return items + count; }
+
+    const Intersection* begin() const { return items; }
+
+    const Intersection* end() const { return items + count; }
+
+    Intersection& operator[](std::size_t i) { return items[i]; }
+
+    const Intersection& operator[](std::size_t i) const { return items[i]; }
+
+    private:
+    void grow(std::size_t needed);
+
+    Intersection* items = local;
+    std::size_t count = 0;
+    std::size_t cap = inline_capacity;
+    Arena* arena;
+    // of the arena when the list spilled into it
+    unsigned generation = 0;
+    Intersection local[inline_capacity];
+};
+
+// The visible intersection: the one with the lowest non-negative t.
+// nullptr if there is none. xs does not need to be sorted.
+const Intersection* hit(std::span<const Intersection> xs);
+
+void sort_intersections(std::span<Intersection> xs);
+
+#endif
@@ -0,0 +1,290 @@
+#include "lighting.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include "trace.h"
+#include "cpu.h"
+
+#ifdef RAY_TRACER_AVX2
+#include <immintrin.h>
+#endif
+
+Tuple lighting(const Material& m, const PointLight& light, const Tuple& point,
+    const Tuple& eyev, const Tuple& normalv, bool in_shadow) {
+    Tuple effective_color = hadamard_product(m.color, light.intensity);
+    Tuple lightv = normalize(light.position - point);
+    Tuple ambient = effective_color * m.ambient;
+    if (in_shadow) {
+        return ambient;
+    }
+
+    // a negative cosine means the light is on the other side of the surface
+    float light_dot_normal = dot(lightv, normalv);
+    if (light_dot_normal < 0) {
+        return ambient;
+    }
+    Tuple diffuse = effective_color * m.diffuse * light_dot_normal;
+
+    // and here that the light reflects away from the eye
+    Tuple reflectv = reflect(-lightv, normalv);
+    float reflect_dot_eye = dot(reflectv, eyev);
+    if (reflect_dot_eye <= 0) {
+        return ambient + diffuse;
+    }
+    float factor = std::pow(reflect_dot_eye, m.shininess);
+    return ambient + diffuse + light.intensity * (m.specular * factor);
+}
+
+namespace {
+
+// x^y = 2^(y * log2(x)).
+//
+// log2: x = m * 2^e with m in [sqrt(1/2), sqrt(2)), and
+// log2(m) = 2 / ln(2) * atanh(t) with t = (m - 1) / (m + 1), |t| < 0.172,
+// which is an odd series in t. With 4 terms the relative error of
+// log2(m) is below 3e-8, with 2 terms below 2e-4.
+//
+// exp2: 2^z = 2^k * 2^f with k = round(z), |f| <= 0.5, and 2^f from its
+// Taylor series. 7 terms leave an error below 2e-7, 4 terms below 7e-4.
+//
+// The error of z = y * log2(x) is multiplied by |z| in the result, which
+// is where the bounds in lighting.h come from (|z| <= 126).
+
+const float log2_coeffs[4] = {2.8853900817779268f, 0.9617966939259756f,
+                              0.5770780163555854f, 0.4121985831111324f};
+
+const float exp2_coeffs[7] = {1.0f, 0.6931471805599453f, 0.2402265069591007f,
+                              0.0555041086648216f, 0.0096181291076285f,
+                              0.0013333558146428f, 0.0001540353039338f};
+
+const std::uint32_t sqrt_half_bits = 0x3f3504f3;
+
+template <int LogTerms, int ExpTerms>
+float pow_poly(float x, float y) {
+    if (y == 0) return 1;
+    if (!(x >= 1.17549435e-38f)) return 0;
+
+    std::int32_t bits = std::bit_cast<std::int32_t>(x);
+    std::int32_t e = (bits - static_cast<std::int32_t>(sqrt_half_bits)) >> 23;
+    float m = std::bit_cast<float>(bits - (e << 23));
+    float t = (m - 1) / (m + 1);
+    float t2 = t * t;
+    float s = log2_coeffs[LogTerms - 1];
+    for (int i = LogTerms - 2; i >= 0; i--) s = s * t2 + log2_coeffs[i];
+    float z = y * (e + t * s);
+
+    if (z < -126) return 0;
+    float k = std::floor(z + 0.5f);
+    float f = z - k;
+    float p = exp2_coeffs[ExpTerms - 1];
+    for (int i = ExpTerms - 2; i >= 0; i--) p = p * f + exp2_coeffs[i];
+    return p * std::bit_cast<float>((static_cast<std::int32_t>(k) + 127) << 23);
+}
+
+// LogTerms 0 stands for std::pow
+template <>
+float pow_poly<0, 0>(float x, float y) {
+    return std::pow(x, y);
+}
+
+template <int LogTerms, int ExpTerms>
+void lighting_scalar(const PointLight& light, const HitBatch& h, const char* shadow,
+    TupleBatch& out, int begin, int end) {
+    const float lr = light.intensity.x, lg = light.intensity.y, lb = light.intensity.z;
+    for (int i = begin; i < end; i++) {
+        float lx = light.position.x - h.px[i];
+        float ly = light.position.y - h.py[i];
+        float lz = light.position.z - h.pz[i];
+        float inv_len = 1 / std::sqrt(lx * lx + ly * ly + lz * lz);
+        lx *= inv_len; ly *= inv_len; lz *= inv_len;
+
+        float er = h.red[i] * lr, eg = h.green[i] * lg, eb = h.blue[i] * lb;
+        float light_dot_normal = lx * h.nx[i] + ly * h.ny[i] + lz * h.nz[i];
+        bool lit = light_dot_normal >= 0 && !(shadow && shadow[i]);
+        float d = lit ? h.diffuse[i] * light_dot_normal : 0;
+        float a = h.ambient[i];
+
+        // reflect(-l, n) . e without building the reflected vector
+        float normal_dot_eye = h.nx[i] * h.ex[i] + h.ny[i] * h.ey[i] + h.nz[i] * h.ez[i];
+        float light_dot_eye = lx * h.ex[i] + ly * h.ey[i] + lz * h.ez[i];
+        float reflect_dot_eye = 2 * light_dot_normal * normal_dot_eye - light_dot_eye;
+        float s = 0;
+        if (lit && reflect_dot_eye > 0) {
+            s = h.specular[i] * pow_poly<LogTerms, ExpTerms>(reflect_dot_eye, h.shininess[i]);
+        }
+
+        out.x[i] = er * (a + d) + lr * s;
+        out.y[i] = eg * (a + d) + lg * s;
+        out.z[i] = eb * (a + d) + lb * s;
+        out.w[i] = 0;
+    }
+}
+
+#ifdef RAY_TRACER_AVX2
+// The scalar kernel 8 hits at a time, with the branches turned into
+// masks.
+template <int LogTerms, int ExpTerms>
+__attribute__((target("avx2,fma")))
+void lighting_avx2(const PointLight& light, const HitBatch& h, const char* shadow,
+    TupleBatch& out, int begin, int end) {
+    const __m256 one = _mm256_set1_ps(1);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 lpx = _mm256_set1_ps(light.position.x);
+    const __m256 lpy = _mm256_set1_ps(light.position.y);
+    const __m256 lpz = _mm256_set1_ps(light.position.z);
+    const __m256 lr = _mm256_set1_ps(light.intensity.x);
+    const __m256 lg = _mm256_set1_ps(light.intensity.y);
+    const __m256 lb = _mm256_set1_ps(light.intensity.z);
+
+    int i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 lx = _mm256_sub_ps(lpx, _mm256_loadu_ps(&h.px[i]));
+        __m256 ly = _mm256_sub_ps(lpy, _mm256_loadu_ps(&h.py[i]));
+        __m256 lz = _mm256_sub_ps(lpz, _mm256_loadu_ps(&h.pz[i]));
+        __m256 len2 = _mm256_fmadd_ps(lz, lz, _mm256_fmadd_ps(ly, ly, _mm256_mul_ps(lx, lx)));
+        __m256 inv_len = _mm256_div_ps(one, _mm256_sqrt_ps(len2));
+        lx = _mm256_mul_ps(lx, inv_len);
+        ly = _mm256_mul_ps(ly, inv_len);
+        lz = _mm256_mul_ps(lz, inv_len);
+
+        __m256 nx = _mm256_loadu_ps(&h.nx[i]);
+        __m256 ny = _mm256_loadu_ps(&h.ny[i]);
+        __m256 nz = _mm256_loadu_ps(&h.nz[i]);
+        __m256 ex = _mm256_loadu_ps(&h.ex[i]);
+        __m256 ey = _mm256_loadu_ps(&h.ey[i]);
+        __m256 ez = _mm256_loadu_ps(&h.ez[i]);
+
+        __m256 ldn = _mm256_fmadd_ps(lz, nz, _mm256_fmadd_ps(ly, ny, _mm256_mul_ps(lx, nx)));
+        __m256 lit = _mm256_cmp_ps(ldn, zero, _CMP_GE_OQ);
+        if (shadow) {
+            __m256i flags = _mm256_cvtepu8_epi32(
+                _mm_loadl_epi64(reinterpret_cast<const __m128i*>(shadow + i)));
+            __m256i unshadowed = _mm256_cmpeq_epi32(flags, _mm256_setzero_si256());
+            lit = _mm256_and_ps(lit, _mm256_castsi256_ps(unshadowed));
+        }
+        __m256 d = _mm256_and_ps(lit, _mm256_mul_ps(_mm256_loadu_ps(&h.diffuse[i]), ldn));
+        __m256 ad = _mm256_add_ps(_mm256_loadu_ps(&h.ambient[i]), d);
+
+        __m256 nde = _mm256_fmadd_ps(nz, ez, _mm256_fmadd_ps(ny, ey, _mm256_mul_ps(nx, ex)));
+        __m256 lde = _mm256_fmadd_ps(lz, ez, _mm256_fmadd_ps(ly, ey, _mm256_mul_ps(lx, ex)));
+        __m256 rde = _mm256_fmsub_ps(_mm256_add_ps(ldn, ldn), nde, lde);
+        __m256 shine = _mm256_and_ps(lit, _mm256_cmp_ps(rde, zero, _CMP_GT_OQ));
+
+        // rde^shininess, see pow_poly()
+        __m256 y = _mm256_loadu_ps(&h.shininess[i]);
+        __m256i bits = _mm256_castps_si256(rde);
+        __m256i e = _mm256_srai_epi32(_mm256_sub_epi32(bits,
+            _mm256_set1_epi32(sqrt_half_bits)), 23);
+        __m256 m = _mm256_castsi256_ps(_mm256_sub_epi32(bits, _mm256_slli_epi32(e, 23)));
+        __m256 t = _mm256_div_ps(_mm256_sub_ps(m, one), _mm256_add_ps(m, one));
+        __m256 t2 = _mm256_mul_ps(t, t);
+        __m256 s = _mm256_set1_ps(log2_coeffs[LogTerms - 1]);
+        for (int k = LogTerms - 2; k >= 0; k--) {
+            s = _mm256_fmadd_ps(s, t2, _mm256_set1_ps(log2_coeffs[k]));
+        }
+        __m256 z = _mm256_mul_ps(y, _mm256_fmadd_ps(t, s, _mm256_cvtepi32_ps(e)));
+        // results that would be subnormal are flushed to 0
+        __m256 normal = _mm256_cmp_ps(z, _mm256_set1_ps(-126), _CMP_GE_OQ);
+        normal = _mm256_and_ps(normal,
+            _mm256_cmp_ps(rde, _mm256_set1_ps(1.17549435e-38f), _CMP_GE_OQ));
+        z = _mm256_max_ps(z, _mm256_set1_ps(-126));
+        __m256 k = _mm256_round_ps(z, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        __m256 f = _mm256_sub_ps(z, k);
+        __m256 p = _mm256_set1_ps(exp2_coeffs[ExpTerms - 1]);
+        for (int j = ExpTerms - 2; j >= 0; j--) {
+            p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(exp2_coeffs[j]));
+        }
+        __m256 scale = _mm256_castsi256_ps(_mm256_slli_epi32(
+            _mm256_add_epi32(_mm256_cvtps_epi32(k), _mm256_set1_epi32(127)), 23));
+        __m256 factor = _mm256_and_ps(normal, _mm256_mul_ps(p, scale));
+        // x^0 is 1
+        factor = _mm256_blendv_ps(factor, one, _mm256_cmp_ps(y, zero, _CMP_EQ_OQ));
+
+        __m256 spec = _mm256_and_ps(shine,
+            _mm256_mul_ps(_mm256_loadu_ps(&h.specular[i]), factor));
+
+        __m256 er = _mm256_mul_ps(_mm256_loadu_ps(&h.red[i]), lr);
+        __m256 eg = _mm256_mul_ps(_mm256_loadu_ps(&h.green[i]), lg);
+        __m256 eb = _mm256_mul_ps(_mm256_loadu_ps(&h.blue[i]), lb);
+        _mm256_storeu_ps(&out.x[i], _mm256_fmadd_ps(er, ad, _mm256_mul_ps(lr, spec)));
+        _mm256_storeu_ps(&out.y[i], _mm256_fmadd_ps(eg, ad, _mm256_mul_ps(lg, spec)));
+        _mm256_storeu_ps(&out.z[i], _mm256_fmadd_ps(eb, ad, _mm256_mul_ps(lb, spec)));
+        _mm256_storeu_ps(&out.w[i], zero);
+    }
+    lighting_scalar<LogTerms, ExpTerms>(light, h, shadow, out, i, end);
+}
+#endif
+
+template <int LogTerms, int ExpTerms>
+void lighting_range(const PointLight& light, const HitBatch& h, const char* shadow,
+    TupleBatch& out, int begin, int end) {
+#ifdef RAY_TRACER_AVX2
+    if (cpu_has_avx2()) {
+        lighting_avx2<LogTerms, ExpTerms>(light, h, shadow, out, begin, end);
+        return;
+    }
+#endif
+    lighting_scalar<LogTerms, ExpTerms>(light, h, shadow, out, begin, end);
+}
+
+}
+
+float specular_pow(float x, float y, PowMode mode) {
+    switch (mode) {
+        case PowMode::bounded: return pow_poly<4, 7>(x, y);
+        case PowMode::fast: return pow_poly<2, 4>(x, y);
+        default: return pow_poly<0, 0>(x, y);
+    }
+}
+
+int HitBatch::size() const {
+    return px.size();
+}
+
+void HitBatch::resize(int n) {
+    for (std::vector<float>* v : {&px, &py, &pz, &ex, &ey, &ez, &nx, &ny, &nz,
+            &red, &green, &blue, &ambient, &diffuse, &specular, &shininess}) {
+        v->resize(n);
+    }
+}
+
+void HitBatch::clear() {
+    resize(0);
+}
+
+void HitBatch::push_back(const Tuple& point, const Tuple& eyev, const Tuple& normalv,
+    const Material& m) {
+    px.push_back(point.x); py.push_back(point.y); pz.push_back(point.z);
+    ex.push_back(eyev.x); ey.push_back(eyev.y); ez.push_back(eyev.z);
+    nx.push_back(normalv.x); ny.push_back(normalv.y); nz.push_back(normalv.z);
+    red.push_back(m.color.x); green.push_back(m.color.y); blue.push_back(m.color.z);
+    ambient.push_back(m.ambient);
+    diffuse.push_back(m.diffuse);
+    specular.push_back(m.specular);
+    shininess.push_back(m.shininess);
+}
+
+void lighting(const PointLight& light, const HitBatch& hits, TupleBatch& out,
+    PowMode mode) {
+    lighting(light, hits, {}, out, mode);
+}
+
+void lighting(const PointLight& light, const HitBatch& hits,
+    std::span<const char> in_shadow, TupleBatch& out, PowMode mode) {
+    TRACE_SCOPE("lighting(HitBatch)");
+    int n = hits.size();
+    const char* shadow = in_shadow.empty() ? nullptr : in_shadow.data();
+    out.resize(n);
+    switch (mode) {
+        case PowMode::bounded:
+            lighting_range<4, 7>(light, hits, shadow, out, 0, n);
+            break;
+        case PowMode::fast:
+            lighting_range<2, 4>(light, hits, shadow, out, 0, n);
+            break;
+        default:
+            lighting_scalar<0, 0>(light, hits, shadow, out, 0, n);
+            break;
+    }
+}
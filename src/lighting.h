@@ -0,0 +1,64 @@
+#ifndef LIGHTING_H
+#define LIGHTING_H
+
+#include <span>
+#include <vector>
+#include "tuples.h"
+#include "lights.h"
+#include "materials.h"
+#include "tuple_batch.h"
+
+// Color of point, seen along eyev, with surface normal normalv, lit by
+// light (Phong: ambient + diffuse + specular). eyev and normalv must be
+// normalized. A point in shadow only gets the ambient part.
+Tuple lighting(const Material& m, const PointLight& light, const Tuple& point,
+    const Tuple& eyev, const Tuple& normalv, bool in_shadow = false);
+
+// How the specular highlight raises a cosine to the shininess power
+enum class PowMode {
+    // std::pow, one hit at a time
+    exact,
+    // polynomial log2/exp2, relative error below 3e-5
+    bounded,
+    // shorter polynomials, relative error below 1.5%, and much less for
+    // the bright part of a highlight; fine for previews
+    fast,
+};
+
+// x^y for x in [0, 1] and y >= 0 with the given approximation; results
+// below the smallest normal float are flushed to 0. The batched
+// lighting() uses the same approximation 8 lanes at a time.
+float specular_pow(float x, float y, PowMode mode);
+
+// Hit records in structure-of-arrays form: where each hit is, the eye
+// and normal vectors there (normalized) and the material of the surface.
+struct HitBatch {
+    std::vector<float> px, py, pz;
+    std::vector<float> ex, ey, ez;
+    std::vector<float> nx, ny, nz;
+    // material color and parameters
+    std::vector<float> red, green, blue;
+    std::vector<float> ambient, diffuse, specular, shininess;
+
+    int size() const;
+
+    void resize(int n);
+
+    void clear();
+
+    void push_back(const Tuple& point, const Tuple& eyev, const Tuple& normalv,
+        const Material& m);
+};
+
+// The color of every hit lit by light, in out.x/y/z (w is 0). out is
+// resized to match hits. Uses AVX2 when the CPU supports it, except in
+// PowMode::exact.
+void lighting(const PointLight& light, const HitBatch& hits, TupleBatch& out,
+    PowMode mode = PowMode::bounded);
+
+// Same, with hits[i] in shadow where in_shadow[i] is non-zero, e.g. as
+// filled in by Bvh::is_occluded().
+void lighting(const PointLight& light, const HitBatch& hits,
+    std::span<const char> in_shadow, TupleBatch& out, PowMode mode = PowMode::bounded);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef LIGHTS_H
+#define LIGHTS_H
+
+#include "tuples.h"
+
+// Light with no size, shining the same in every direction
+struct PointLight {
+    Tuple position;
+    Tuple intensity;
+};
+
+#endif
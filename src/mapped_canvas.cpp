@@ -0,0 +1,103 @@
+#include "mapped_canvas.h"
+#include <algorithm>
+#include <cerrno>
+#include <system_error>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+MappedCanvas::MappedCanvas(const std::string& path, int w, int h, int tile_size)
+: width {w}, height {h}, tile_size {tile_size > 0 ? tile_size : 64}
+{
+    tiles_x = (width + this->tile_size - 1) / this->tile_size;
+    tiles_y = (height + this->tile_size - 1) / this->tile_size;
+    // edge tiles are padded to full size, which costs nothing in a sparse file
+    bytes = static_cast<std::size_t>(tiles_x) * tiles_y
+        * this->tile_size * this->tile_size * sizeof(Tuple);
+
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(),
+            "creating " + path);
+    }
+    if (bytes == 0) return;
+
+    if (::ftruncate(fd, bytes) != 0) {
+        int err = errno;
+        ::close(fd);
+        throw std::system_error(err, std::generic_category(), "sizing " + path);
+    }
+    void* p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        int err = errno;
+        ::close(fd);
+        throw std::system_error(err, std::generic_category(), "mapping " + path);
+    }
+    pixels = static_cast<Tuple*>(p);
+}
+
+MappedCanvas::~MappedCanvas() {
+    if (pixels) ::munmap(pixels, bytes);
+    if (fd >= 0) ::close(fd);
+}
+
+std::span<Tuple> MappedCanvas::tile_row(int x, int y) {
+    int end = std::min(width, (x / tile_size + 1) * tile_size);
+    return {pixels + offset(x, y), static_cast<std::size_t>(end - x)};
+}
+
+void MappedCanvas::sync() {
+    if (pixels && ::msync(pixels, bytes, MS_SYNC) != 0) {
+        throw std::system_error(errno, std::generic_category(),
+            "syncing mapped canvas");
+    }
+}
+
+void MappedCanvas::encode(PpmWriter& writer) const {
+    TRACE_SCOPE("write_ppm");
+    writer.write_header(width, height);
+    std::vector<Tuple> row(width);
+    std::size_t band_bytes = static_cast<std::size_t>(tiles_x)
+        * tile_size * tile_size * sizeof(Tuple);
+    std::size_t page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    // everything before this has been released; always a page boundary
+    std::size_t released = 0;
+
+    for (int ty = 0; ty < tiles_y; ty++) {
+        int y_end = std::min(height, (ty + 1) * tile_size);
+        for (int y = ty * tile_size; y < y_end; y++) {
+            for (int x = 0; x < width; x += tile_size) {
+                int n = std::min(tile_size, width - x);
+                const Tuple* src = pixels + offset(x, y);
+                std::copy(src, src + n, row.begin() + x);
+            }
+            writer.write_row(row);
+        }
+        // The band is not needed again. The pages are only dropped from
+        // this mapping; their contents stay in the file. Bands need not
+        // start on a page, so a page shared with the next band is left
+        // for that band to release.
+        std::size_t end = ty + 1 == tiles_y ? bytes
+            : (ty + 1) * band_bytes / page * page;
+        if (end > released) {
+            char* start = reinterpret_cast<char*>(pixels) + released;
+            if (::madvise(start, end - released, MADV_DONTNEED) != 0) {
+                throw std::system_error(errno, std::generic_category(),
+                    "releasing mapped canvas pages");
+            }
+            released = end;
+        }
+    }
+    writer.flush();
+}
+
+void MappedCanvas::write_ppm(std::ostream& out, PpmFormat format) const {
+    PpmWriter writer {out, format};
+    encode(writer);
+}
+
+void MappedCanvas::write_ppm(int fd, PpmFormat format) const {
+    PpmWriter writer {fd, format};
+    encode(writer);
+}
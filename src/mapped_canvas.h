@@ -0,0 +1,76 @@
+#ifndef MAPPED_CANVAS_H
+#define MAPPED_CANVAS_H
+
+#include <cstddef>
+#include <ostream>
+#include <span>
+#include <string>
+#include "tuples.h"
+#include "ppm.h"
+#include "trace.h"
+
+// Canvas whose pixels live in a memory-mapped file instead of RAM, for
+// images bigger than the memory of the machine. The file is created
+// sparse, so untouched pixels are black and take no disk space.
+//
+// Pixels are stored in square tiles of tile_size x tile_size, each one
+// contiguous in the file, so rendering a tile at a time only touches a
+// few pages. render() in render.h renders whole tiles at a time.
+class MappedCanvas {
+    public:
+    int width;
+    int height;
+    int tile_size;
+
+    // Creates (or truncates) the file at path.
+    // Throws std::system_error if it cannot be created or mapped.
+    MappedCanvas(const std::string& path, int w, int h, int tile_size = 64);
+
+    // unmaps the image; the file stays on disk
+    ~MappedCanvas();
+
+    MappedCanvas(const MappedCanvas&) = delete;
+
+    MappedCanvas& operator=(const MappedCanvas&) = delete;
+
+    void write_pixel(int x, int y, Tuple color) {
+        TRACE_COUNT(pixels_written, 1);
+        pixels[offset(x, y)] = color;
+    }
+
+    Tuple pixel_at(int x, int y) const {
+        return pixels[offset(x, y)];
+    }
+
+    // the part of row y inside the tile that holds (x, y), from x to the
+    // right edge of the tile
+    std::span<Tuple> tile_row(int x, int y);
+
+    // writes dirty pages back to the file
+    void sync();
+
+    // Streams the image row by row straight from the mapping. Pages are
+    // released once a band of tiles has been encoded, so memory use stays
+    // at about one band whatever the image size.
+    void write_ppm(std::ostream& out, PpmFormat format = PpmFormat::P3) const;
+
+    void write_ppm(int fd, PpmFormat format = PpmFormat::P3) const;
+
+    private:
+    std::size_t offset(int x, int y) const {
+        std::size_t tile = static_cast<std::size_t>(y / tile_size) * tiles_x
+            + x / tile_size;
+        return tile * tile_size * tile_size
+            + static_cast<std::size_t>(y % tile_size) * tile_size + x % tile_size;
+    }
+
+    void encode(PpmWriter& writer) const;
+
+    int tiles_x;
+    int tiles_y;
+    int fd = -1;
+    std::size_t bytes = 0;
+    Tuple* pixels = nullptr;
+};
+
+#endif
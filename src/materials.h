@@ -0,0 +1,15 @@
+#ifndef MATERIALS_H
+#define MATERIALS_H
+
+#include "tuples.h"
+
+// Surface parameters of the Phong reflection model
+struct Material {
+    Tuple color = {1, 1, 1, 0};
+    float ambient = 0.1f;
+    float diffuse = 0.9f;
+    float specular = 0.9f;
+    float shininess = 200;
+};
+
+#endif
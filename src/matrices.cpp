@@ -1,8 +1,18 @@
 #include "matrices.h"
+#include "tuples_simd.h"
 
-bool operator==(const Matrix& m1, const Matrix& m2) {
-    for (int i = 0; i < m1.size(); i++) {
-        for (int j = 0; j < m1[0].size(); j++) {
+template <typename T>
+static bool lu_decompose(const BasicMatrix<T>& m, std::vector<double>& lu,
+                        std::vector<int>& perm, int& sign);
+
+template <typename T>
+static void lu_invert(const std::vector<double>& lu, const std::vector<int>& perm,
+                    int n, BasicMatrix<T>& res);
+
+template <typename T>
+bool operator==(const BasicMatrix<T>& m1, const BasicMatrix<T>& m2) {
+    for (std::size_t i = 0; i < m1.size(); i++) {
+        for (std::size_t j = 0; j < m1[0].size(); j++) {
             if (!equal(m1[i][j], m2[i][j])) {
                 return false;
             }
@@ -11,9 +21,10 @@ bool operator==(const Matrix& m1, const Matrix& m2) {
     return true;
 }
 
-bool operator!=(const Matrix& m1, const Matrix& m2)  {
-    for (int i = 0; i < m1.size(); i++) {
-        for (int j = 0; j < m1[0].size(); j++) {
+template <typename T>
+bool operator!=(const BasicMatrix<T>& m1, const BasicMatrix<T>& m2)  {
+    for (std::size_t i = 0; i < m1.size(); i++) {
+        for (std::size_t j = 0; j < m1[0].size(); j++) {
             if (!equal(m1[i][j], m2[i][j])) {
                 return true;
             }
@@ -22,9 +33,11 @@ bool operator!=(const Matrix& m1, const Matrix& m2)  {
     return false;
 }
 
-Matrix operator*(const Matrix& m1, const Matrix& m2) {
+template <typename T>
+BasicMatrix<T> operator*(const BasicMatrix<T>& m1, const BasicMatrix<T>& m2) {
+    TRACE_COUNT(matrix_multiplies, 1);
     // check if matrices are 4x4?
-    Matrix res = {{0, 0, 0, 0},
+    BasicMatrix<T> res = {{0, 0, 0, 0},
                  {0, 0, 0, 0},
                  {0, 0, 0, 0},
                  {0, 0, 0, 0}};
@@ -41,60 +54,51 @@ Matrix operator*(const Matrix& m1, const Matrix& m2) {
     return res;
 }
 
-Tuple operator*(const Matrix& m, const Tuple& t) {
-    Tuple res;
-    
-    res.x = m[0][0] * t.x +
-            m[0][1] * t.y +
-            m[0][2] * t.z +
-            m[0][3] * t.w;
-
-    res.y = m[1][0] * t.x +
-            m[1][1] * t.y +
-            m[1][2] * t.z +
-            m[1][3] * t.w;
-    
-    res.z = m[2][0] * t.x +
-            m[2][1] * t.y +
-            m[2][2] * t.z +
-            m[2][3] * t.w;
-        
-    res.w = m[3][0] * t.x +
-            m[3][1] * t.y +
-            m[3][2] * t.z +
-            m[3][3] * t.w;
-    
-    return res;
+template <typename T>
+BasicTuple<T> operator*(const BasicMatrix<T>& m, const BasicTuple<T>& t) {
+    const T* rows[4] = {m[0].data(), m[1].data(), m[2].data(), m[3].data()};
+    return simd::mat_mul(rows, t);
 }
 
-Matrix transpose(const Matrix& m) {
-    Matrix res = m;
+template <typename T>
+BasicMatrix<T> transpose(const BasicMatrix<T>& m) {
+    BasicMatrix<T> res = m;
 
-    for (int i = 0; i < res.size(); i++) {
-        for (int j = i; j < res[0].size(); j++) {
+    for (std::size_t i = 0; i < res.size(); i++) {
+        for (std::size_t j = i; j < res[0].size(); j++) {
             std::swap( res[i][j], res[j][i] );
         }
     }
     return res;
 }
 
-float determinant(const Matrix& m) {
-    if ( m.size() == 2 ) {
+template <typename T>
+T determinant(const BasicMatrix<T>& m) {
+    int n = m.size();
+    if ( n == 2 ) {
         return m[0][0] * m[1][1] - m[0][1] * m[1][0];
+    } else if ( n == 4 ) {
+        return determinant(to_mat4<T>(m));
     } else {
-        float det = 0;
-
-        for (int j = 0; j < m.size(); j++) {
-            det += m[0][j] * cofactor(m, 0, j);
+        std::vector<double> lu;
+        std::vector<int> perm;
+        int sign = 0;
+        if (!lu_decompose(m, lu, perm, sign)) {
+            return 0;
         }
 
+        double det = sign;
+        for (int i = 0; i < n; i++) {
+            det *= lu[i * n + i];
+        }
         return det;
     }
 }
 
-Matrix submatrix(const Matrix& m, int row, int col) {
+template <typename T>
+BasicMatrix<T> submatrix(const BasicMatrix<T>& m, int row, int col) {
     int n = m.size();
-    Matrix subm (n - 1, std::vector<float>(n - 1));
+    BasicMatrix<T> subm (n - 1, std::vector<T>(n - 1));
 
     int isub = 0, jsub = 0;
     for (int i = 0; i < n; i++) {
@@ -111,11 +115,13 @@ Matrix submatrix(const Matrix& m, int row, int col) {
     return subm;
 }
 
-float minor(const Matrix& m, int row, int col) {
+template <typename T>
+T minor(const BasicMatrix<T>& m, int row, int col) {
     return determinant(submatrix(m, row, col));
 }
 
-float cofactor(const Matrix& m, int row, int col) {
+template <typename T>
+T cofactor(const BasicMatrix<T>& m, int row, int col) {
     if ( (row + col) % 2 == 0 ) {
         return minor(m, row, col);
     } else {
@@ -123,21 +129,295 @@ float cofactor(const Matrix& m, int row, int col) {
     }
 }
 
-bool isInvertible(const Matrix& m) {
+template <typename T>
+bool isInvertible(const BasicMatrix<T>& m) {
     return determinant(m) != 0;
 }
 
-Matrix inverse(const Matrix& m) {
-    // check if is invertible !!
-    // throw exception
+template <typename T>
+BasicMatrix<T> inverse(const BasicMatrix<T>& m) {
+    // use checked_inverse() to detect singular matrices
+    if (m.size() == 4) {
+        return inverse(to_mat4<T>(m));
+    }
+
+    TRACE_SCOPE("inverse(Matrix)");
+    TRACE_COUNT(inversions, 1);
+    int n = m.size();
+    BasicMatrix<T> res (n, std::vector<T> (n, 0));
+    std::vector<double> lu;
+    std::vector<int> perm;
+    int sign = 0;
+    lu_decompose(m, lu, perm, sign);
+    lu_invert(lu, perm, n, res);
+    return res;
+}
+
+template <typename T>
+std::optional<BasicMatrix<T>> checked_inverse(const BasicMatrix<T>& m) {
+    if (m.size() == 4) {
+        std::optional<BasicMat4<T>> inv = checked_inverse(to_mat4<T>(m));
+        if (!inv) return std::nullopt;
+        return BasicMatrix<T>(*inv);
+    }
+
+    TRACE_SCOPE("checked_inverse(Matrix)");
+    TRACE_COUNT(inversions, 1);
+    int n = m.size();
+    std::vector<double> lu;
+    std::vector<int> perm;
+    int sign = 0;
+    if (!lu_decompose(m, lu, perm, sign)) {
+        return std::nullopt;
+    }
+
+    BasicMatrix<T> res (n, std::vector<T> (n, 0));
+    lu_invert(lu, perm, n, res);
+    return res;
+}
+
+// LU decomposition with partial pivoting, PA = LU.
+// L (unit diagonal, implicit) and U are packed row-major into lu.
+// Returns false if the matrix is singular.
+template <typename T>
+static bool lu_decompose(const BasicMatrix<T>& m, std::vector<double>& lu,
+                        std::vector<int>& perm, int& sign) {
     int n = m.size();
-    Matrix m2 (n, std::vector<float> (n, 0));
-    float det = determinant(m);
+    lu.assign(n * n, 0);
+    perm.resize(n);
+    sign = 1;
+
+    for (int i = 0; i < n; i++) {
+        perm[i] = i;
+        for (int j = 0; j < n; j++) {
+            lu[i * n + j] = m[i][j];
+        }
+    }
+
+    for (int k = 0; k < n; k++) {
+        // pick the largest pivot in column k
+        int p = k;
+        for (int i = k + 1; i < n; i++) {
+            if (std::abs(lu[i * n + k]) > std::abs(lu[p * n + k])) {
+                p = i;
+            }
+        }
+        if (lu[p * n + k] == 0) {
+            return false;
+        }
+        if (p != k) {
+            for (int j = 0; j < n; j++) {
+                std::swap(lu[p * n + j], lu[k * n + j]);
+            }
+            std::swap(perm[p], perm[k]);
+            sign = -sign;
+        }
+
+        for (int i = k + 1; i < n; i++) {
+            double f = lu[i * n + k] / lu[k * n + k];
+            lu[i * n + k] = f;
+            for (int j = k + 1; j < n; j++) {
+                lu[i * n + j] -= f * lu[k * n + j];
+            }
+        }
+    }
+    return true;
+}
+
+// Solves LU x = P e_c for every column c of the identity.
+template <typename T>
+static void lu_invert(const std::vector<double>& lu, const std::vector<int>& perm,
+                    int n, BasicMatrix<T>& res) {
+    std::vector<double> x(n);
+
+    for (int c = 0; c < n; c++) {
+        // forward substitution with L
+        for (int i = 0; i < n; i++) {
+            double sum = perm[i] == c ? 1 : 0;
+            for (int j = 0; j < i; j++) {
+                sum -= lu[i * n + j] * x[j];
+            }
+            x[i] = sum;
+        }
+        // back substitution with U
+        for (int i = n - 1; i >= 0; i--) {
+            double sum = x[i];
+            for (int j = i + 1; j < n; j++) {
+                sum -= lu[i * n + j] * x[j];
+            }
+            x[i] = sum / lu[i * n + i];
+        }
+        for (int i = 0; i < n; i++) {
+            res[i][c] = x[i];
+        }
+    }
+}
+
+template <typename T>
+BasicMat4<T>::operator BasicMatrix<T>() const {
+    return {{m[0][0], m[0][1], m[0][2], m[0][3]},
+            {m[1][0], m[1][1], m[1][2], m[1][3]},
+            {m[2][0], m[2][1], m[2][2], m[2][3]},
+            {m[3][0], m[3][1], m[3][2], m[3][3]}};
+}
 
-    for (int r = 0; r < n; r++) {
-        for (int c = 0; c < n; c++) {
-            m2[c][r] = cofactor(m, r, c) / det;
+template <typename T>
+BasicMat4<T> to_mat4(const BasicMatrix<Scalar<T>>& m) {
+    BasicMat4<T> res;
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            res[i][j] = m[i][j];
+        }
+    }
+    return res;
+}
+
+template <typename T>
+bool operator==(const BasicMat4<T>& m1, const BasicMat4<T>& m2) {
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            if (!equal(m1[i][j], m2[i][j])) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+template <typename T>
+bool operator!=(const BasicMat4<T>& m1, const BasicMat4<T>& m2) {
+    return !(m1 == m2);
+}
+
+template <typename T>
+BasicTuple<T> operator*(const BasicMat4<T>& m, const BasicTuple<T>& t) {
+    const T* rows[4] = {m[0], m[1], m[2], m[3]};
+    return simd::mat_mul(rows, t);
+}
+
+// Adjugate of a 4x4 matrix. The 2x2 determinants of the top two rows (s)
+// and the bottom two rows (c) are shared by every cofactor, so the whole
+// inverse costs a few dozen multiplies and no allocations.
+// Returns the determinant; adj is left unscaled.
+template <typename T>
+static T adjugate4(const BasicMat4<T>& a, BasicMat4<T>& adj) {
+    T s0 = a[0][0] * a[1][1] - a[1][0] * a[0][1];
+    T s1 = a[0][0] * a[1][2] - a[1][0] * a[0][2];
+    T s2 = a[0][0] * a[1][3] - a[1][0] * a[0][3];
+    T s3 = a[0][1] * a[1][2] - a[1][1] * a[0][2];
+    T s4 = a[0][1] * a[1][3] - a[1][1] * a[0][3];
+    T s5 = a[0][2] * a[1][3] - a[1][2] * a[0][3];
+
+    T c5 = a[2][2] * a[3][3] - a[3][2] * a[2][3];
+    T c4 = a[2][1] * a[3][3] - a[3][1] * a[2][3];
+    T c3 = a[2][1] * a[3][2] - a[3][1] * a[2][2];
+    T c2 = a[2][0] * a[3][3] - a[3][0] * a[2][3];
+    T c1 = a[2][0] * a[3][2] - a[3][0] * a[2][2];
+    T c0 = a[2][0] * a[3][1] - a[3][0] * a[2][1];
+
+    adj[0][0] =  a[1][1] * c5 - a[1][2] * c4 + a[1][3] * c3;
+    adj[0][1] = -a[0][1] * c5 + a[0][2] * c4 - a[0][3] * c3;
+    adj[0][2] =  a[3][1] * s5 - a[3][2] * s4 + a[3][3] * s3;
+    adj[0][3] = -a[2][1] * s5 + a[2][2] * s4 - a[2][3] * s3;
+
+    adj[1][0] = -a[1][0] * c5 + a[1][2] * c2 - a[1][3] * c1;
+    adj[1][1] =  a[0][0] * c5 - a[0][2] * c2 + a[0][3] * c1;
+    adj[1][2] = -a[3][0] * s5 + a[3][2] * s2 - a[3][3] * s1;
+    adj[1][3] =  a[2][0] * s5 - a[2][2] * s2 + a[2][3] * s1;
+
+    adj[2][0] =  a[1][0] * c4 - a[1][1] * c2 + a[1][3] * c0;
+    adj[2][1] = -a[0][0] * c4 + a[0][1] * c2 - a[0][3] * c0;
+    adj[2][2] =  a[3][0] * s4 - a[3][1] * s2 + a[3][3] * s0;
+    adj[2][3] = -a[2][0] * s4 + a[2][1] * s2 - a[2][3] * s0;
+
+    adj[3][0] = -a[1][0] * c3 + a[1][1] * c1 - a[1][2] * c0;
+    adj[3][1] =  a[0][0] * c3 - a[0][1] * c1 + a[0][2] * c0;
+    adj[3][2] = -a[3][0] * s3 + a[3][1] * s1 - a[3][2] * s0;
+    adj[3][3] =  a[2][0] * s3 - a[2][1] * s1 + a[2][2] * s0;
+
+    return s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+}
+
+template <typename T>
+T determinant(const BasicMat4<T>& a) {
+    T s0 = a[0][0] * a[1][1] - a[1][0] * a[0][1];
+    T s1 = a[0][0] * a[1][2] - a[1][0] * a[0][2];
+    T s2 = a[0][0] * a[1][3] - a[1][0] * a[0][3];
+    T s3 = a[0][1] * a[1][2] - a[1][1] * a[0][2];
+    T s4 = a[0][1] * a[1][3] - a[1][1] * a[0][3];
+    T s5 = a[0][2] * a[1][3] - a[1][2] * a[0][3];
+
+    T c5 = a[2][2] * a[3][3] - a[3][2] * a[2][3];
+    T c4 = a[2][1] * a[3][3] - a[3][1] * a[2][3];
+    T c3 = a[2][1] * a[3][2] - a[3][1] * a[2][2];
+    T c2 = a[2][0] * a[3][3] - a[3][0] * a[2][3];
+    T c1 = a[2][0] * a[3][2] - a[3][0] * a[2][2];
+    T c0 = a[2][0] * a[3][1] - a[3][0] * a[2][1];
+
+    return s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+}
+
+template <typename T>
+bool isInvertible(const BasicMat4<T>& m) {
+    return determinant(m) != 0;
+}
+
+template <typename T>
+BasicMat4<T> inverse(const BasicMat4<T>& m) {
+    TRACE_SCOPE("inverse(Mat4)");
+    TRACE_COUNT(inversions, 1);
+    BasicMat4<T> res;
+    T inv_det = 1 / adjugate4(m, res);
+
+    for (int r = 0; r < 4; r++) {
+        for (int c = 0; c < 4; c++) {
+            res[r][c] *= inv_det;
+        }
+    }
+    return res;
+}
+
+template <typename T>
+std::optional<BasicMat4<T>> checked_inverse(const BasicMat4<T>& m) {
+    TRACE_SCOPE("checked_inverse(Mat4)");
+    TRACE_COUNT(inversions, 1);
+    BasicMat4<T> res;
+    T det = adjugate4(m, res);
+    if (det == 0 || !std::isfinite(det)) {
+        return std::nullopt;
+    }
+
+    T inv_det = 1 / det;
+    for (int r = 0; r < 4; r++) {
+        for (int c = 0; c < 4; c++) {
+            res[r][c] *= inv_det;
         }
     }
-    return m2;
-}
\ No newline at end of file
+    return res;
+}
+
+#define INSTANTIATE_MATRICES(T) \
+    template bool operator==(const BasicMatrix<T>&, const BasicMatrix<T>&); \
+    template bool operator!=(const BasicMatrix<T>&, const BasicMatrix<T>&); \
+    template BasicMatrix<T> operator*(const BasicMatrix<T>&, const BasicMatrix<T>&); \
+    template BasicTuple<T> operator*(const BasicMatrix<T>&, const BasicTuple<T>&); \
+    template BasicMatrix<T> transpose(const BasicMatrix<T>&); \
+    template T determinant(const BasicMatrix<T>&); \
+    template BasicMatrix<T> submatrix(const BasicMatrix<T>&, int, int); \
+    template T minor(const BasicMatrix<T>&, int, int); \
+    template T cofactor(const BasicMatrix<T>&, int, int); \
+    template bool isInvertible(const BasicMatrix<T>&); \
+    template BasicMatrix<T> inverse(const BasicMatrix<T>&); \
+    template std::optional<BasicMatrix<T>> checked_inverse(const BasicMatrix<T>&); \
+    template struct BasicMat4<T>; \
+    template BasicMat4<T> to_mat4<T>(const BasicMatrix<T>&); \
+    template bool operator==(const BasicMat4<T>&, const BasicMat4<T>&); \
+    template bool operator!=(const BasicMat4<T>&, const BasicMat4<T>&); \
+    template BasicTuple<T> operator*(const BasicMat4<T>&, const BasicTuple<T>&); \
+    template T determinant(const BasicMat4<T>&); \
+    template bool isInvertible(const BasicMat4<T>&); \
+    template BasicMat4<T> inverse(const BasicMat4<T>&); \
+    template std::optional<BasicMat4<T>> checked_inverse(const BasicMat4<T>&);
+
+INSTANTIATE_MATRICES(float)
+INSTANTIATE_MATRICES(double)
@@ -3,9 +3,45 @@
 
 #include "tools.h"
 #include "vector"
+#include "type_traits"
+#include "optional"
 #include "tuples.h"
+#include "trace.h"
 
-using Matrix = std::vector<std::vector<float>>;
+// Matrices over float or double; everything below is instantiated for
+// both in matrices.cpp.
+template <typename T>
+using BasicMatrix = std::vector<std::vector<T>>;
+
+using Matrix = BasicMatrix<float>;
+
+using MatrixD = BasicMatrix<double>;
+
+// Fixed-size 4x4 matrix, row-major in one contiguous block.
+// Used for transformations instead of Matrix, which allocates every row.
+template <typename T>
+struct alignas(16) BasicMat4 {
+    T m[4][4];
+
+    constexpr T* operator[](int row) { return m[row]; }
+
+    constexpr const T* operator[](int row) const { return m[row]; }
+
+    // lets a Mat4 be used wherever a Matrix is expected
+    operator BasicMatrix<T>() const;
+};
+
+using Mat4 = BasicMat4<float>;
+
+using Mat4D = BasicMat4<double>;
+
+static_assert(std::is_trivially_copyable<Mat4>::value, 
+    "Mat4 must be trivially copyable");
+
+// m must be 4x4. The precision is not deduced, so that braced lists work:
+// to_mat4({{...}}) is a Mat4, to_mat4<double>(m) a Mat4D.
+template <typename T = float>
+BasicMat4<T> to_mat4(const BasicMatrix<Scalar<T>>& m);
 
 namespace matrices {
     const Matrix identity = {{1, 0, 0, 0},
@@ -13,32 +49,108 @@ namespace matrices {
                             {0, 0, 1, 0},
                             {0, 0, 0, 1}};
 
+    template <typename T>
+    constexpr BasicMat4<T> basic_identity4 = {{{1, 0, 0, 0},
+                            {0, 1, 0, 0},
+                            {0, 0, 1, 0},
+                            {0, 0, 0, 1}}};
+
+    constexpr Mat4 identity4 = basic_identity4<float>;
 }
 
-bool operator==(const Matrix& m1, const Matrix& m2);
+template <typename T>
+bool operator==(const BasicMatrix<T>& m1, const BasicMatrix<T>& m2);
 
-bool operator!=(const Matrix& m1, const Matrix& m2);
+template <typename T>
+bool operator!=(const BasicMatrix<T>& m1, const BasicMatrix<T>& m2);
 
-Matrix operator*(const Matrix& m1, const Matrix& m2);
+template <typename T>
+BasicMatrix<T> operator*(const BasicMatrix<T>& m1, const BasicMatrix<T>& m2);
 
-Tuple operator*(const Matrix& m, const Tuple& t);
+template <typename T>
+BasicTuple<T> operator*(const BasicMatrix<T>& m, const BasicTuple<T>& t);
 
 // maybe overload vector times matrix
 // it can be implemented as
 // transpose(x)*A = transpose(transpose(A) * x)
 
-Matrix transpose(const Matrix& m);
+template <typename T>
+BasicMatrix<T> transpose(const BasicMatrix<T>& m);
+
+template <typename T>
+T determinant(const BasicMatrix<T>& m);
 
-float determinant(const Matrix& m);
+template <typename T>
+BasicMatrix<T> submatrix(const BasicMatrix<T>& m, int row, int col);
 
-Matrix submatrix(const Matrix& m, int row, int col);
+template <typename T>
+T minor(const BasicMatrix<T>& m, int row, int col);
+
+template <typename T>
+T cofactor(const BasicMatrix<T>& m, int row, int col);
+
+template <typename T>
+bool isInvertible(const BasicMatrix<T>& m);
+
+// Not checked: a singular matrix produces inf/nan entries.
+// 4x4 matrices use the closed form of the Mat4 overload,
+// other sizes an LU decomposition with partial pivoting.
+template <typename T>
+BasicMatrix<T> inverse(const BasicMatrix<T>& m);
+
+// Empty if m is not invertible.
+template <typename T>
+std::optional<BasicMatrix<T>> checked_inverse(const BasicMatrix<T>& m);
+
+template <typename T>
+bool operator==(const BasicMat4<T>& m1, const BasicMat4<T>& m2);
+
+template <typename T>
+bool operator!=(const BasicMat4<T>& m1, const BasicMat4<T>& m2);
+
+// usable in constant expressions
+template <typename T>
+constexpr BasicMat4<T> operator*(const BasicMat4<T>& m1, const BasicMat4<T>& m2) {
+    if (!std::is_constant_evaluated()) TRACE_COUNT(matrix_multiplies, 1);
+    BasicMat4<T> res {};
+
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            res[i][j] = m1[i][0] * m2[0][j] +
+                        m1[i][1] * m2[1][j] +
+                        m1[i][2] * m2[2][j] +
+                        m1[i][3] * m2[3][j];
+        }
+    }
+
+    return res;
+}
+
+template <typename T>
+BasicTuple<T> operator*(const BasicMat4<T>& m, const BasicTuple<T>& t);
+
+template <typename T>
+constexpr BasicMat4<T> transpose(const BasicMat4<T>& m) {
+    BasicMat4<T> res {};
+
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            res[i][j] = m[j][i];
+        }
+    }
+    return res;
+}
 
-float minor(const Matrix& m, int row, int col);
+template <typename T>
+T determinant(const BasicMat4<T>& m);
 
-float cofactor(const Matrix& m, int row, int col);
+template <typename T>
+bool isInvertible(const BasicMat4<T>& m);
 
-bool isInvertible(const Matrix& m);
+template <typename T>
+BasicMat4<T> inverse(const BasicMat4<T>& m);
 
-Matrix inverse(const Matrix& m);
+template <typename T>
+std::optional<BasicMat4<T>> checked_inverse(const BasicMat4<T>& m);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,133 @@
+#include "pipeline.h"
+
+namespace {
+    using clock = std::chrono::steady_clock;
+
+    double ms_since(clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+    }
+}
+
+BandWriter::BandWriter(std::ostream& out, int width, int height, 
+    PipelineOptions options)
+: writer {std::make_unique<PpmWriter>(out, options.format)}, 
+  width {width}, height {height}, options {options},
+  to_writer {static_cast<std::size_t>(std::max(1, options.queued_bands)) + 1}, 
+  spare {static_cast<std::size_t>(std::max(1, options.queued_bands)) + 1}
+{
+    start();
+}
+
+BandWriter::BandWriter(int fd, int width, int height, PipelineOptions options)
+: writer {std::make_unique<PpmWriter>(fd, options.format)}, 
+  width {width}, height {height}, options {options},
+  to_writer {static_cast<std::size_t>(std::max(1, options.queued_bands)) + 1}, 
+  spare {static_cast<std::size_t>(std::max(1, options.queued_bands)) + 1}
+{
+    start();
+}
+
+BandWriter::~BandWriter() {
+    if (!finished) {
+        try {
+            finish();
+        } catch (...) {
+            // destructors must not throw; call finish() to see errors
+        }
+    }
+}
+
+void BandWriter::start() {
+    started = clock::now();
+    options.band_rows = std::max(1, options.band_rows);
+    // one band being rendered plus the ones queued for the writer
+    bands.resize(std::max(1, options.queued_bands) + 1);
+    for (RowBand& b : bands) {
+        b.width = width;
+        spare.push(&b);
+    }
+    thread = std::thread([this] { run(); });
+}
+
+RowBand* BandWriter::next_band() {
+    if (next_row >= height) return nullptr;
+
+    RowBand* band = nullptr;
+    if (!spare.pop(band)) {
+        auto wait_start = clock::now();
+        spare.wait_for_item();
+        spare.pop(band);
+        stats.render_stall_ms += ms_since(wait_start);
+    }
+    band->y0 = next_row;
+    band->y1 = std::min(height, next_row + options.band_rows);
+    band->pixels.resize(static_cast<std::size_t>(band->y1 - band->y0) * width);
+    next_row = band->y1;
+    return band;
+}
+
+void BandWriter::submit(RowBand* band) {
+    // there are never more bands than room in the queue
+    to_writer.push(band);
+    stats.bands++;
+}
+
+PipelineStats BandWriter::finish() {
+    if (finished) return stats;
+    finished = true;
+
+    to_writer.wait_for_room();
+    to_writer.push(nullptr);
+    thread.join();
+
+    stats.writer_busy_ms = writer_busy_ms;
+    stats.writer_stall_ms = writer_stall_ms;
+    stats.total_ms = ms_since(started);
+    if (error) std::rethrow_exception(error);
+    return stats;
+}
+
+// writer thread
+void BandWriter::run() {
+    try {
+        writer->write_header(width, height);
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    while (true) {
+        RowBand* band = nullptr;
+        if (!to_writer.pop(band)) {
+            auto wait_start = clock::now();
+            to_writer.wait_for_item();
+            to_writer.pop(band);
+            writer_stall_ms += ms_since(wait_start);
+        }
+        if (!band) break;
+
+        TRACE_SCOPE("write band");
+        auto busy_start = clock::now();
+        // after an error the bands are only handed back, so the renderer
+        // never waits for buffers that will not come
+        if (!error) {
+            try {
+                for (int y = band->y0; y < band->y1; y++) {
+                    writer->write_row(band->row(y));
+                }
+                TRACE_COUNT(pixels_written, band->pixels.size());
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+        writer_busy_ms += ms_since(busy_start);
+        spare.push(band);
+    }
+
+    if (!error) {
+        try {
+            writer->flush();
+        } catch (...) {
+            error = std::current_exception();
+        }
+    }
+}
@@ -0,0 +1,138 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <ostream>
+#include <span>
+#include <thread>
+#include <vector>
+#include "tuples.h"
+#include "ppm.h"
+#include "render.h"
+#include "spsc_queue.h"
+
+struct PipelineOptions {
+    // rows rendered and handed to the writer at a time
+    int band_rows = 32;
+    // bands that may be waiting for the writer; bounds the memory used
+    int queued_bands = 4;
+    PpmFormat format = PpmFormat::P3;
+    RenderOptions render;
+};
+
+// where the time went, in milliseconds
+struct PipelineStats {
+    double total_ms = 0;
+    // writer encoding and writing bands
+    double writer_busy_ms = 0;
+    // writer waiting for the renderer to finish a band
+    double writer_stall_ms = 0;
+    // renderer waiting for the writer to return a band buffer
+    double render_stall_ms = 0;
+    int bands = 0;
+};
+
+// Rows [y0, y1) of the image, rendered and waiting to be written
+struct RowBand {
+    int y0 = 0;
+    int y1 = 0;
+    int width = 0;
+    std::vector<Tuple> pixels;
+
+    std::span<Tuple> row(int y) {
+        return {pixels.data() + static_cast<std::size_t>(y - y0) * width,
+            static_cast<std::size_t>(width)};
+    }
+};
+
+// Encodes bands as PPM on a background thread while the caller renders
+// the next ones. Bands go to the writer through a lock-free queue and
+// come back through a second one, so a fixed set of buffers is reused.
+// Bands must be submitted in order, from one thread.
+class BandWriter {
+    public:
+    BandWriter(std::ostream& out, int width, int height, 
+        PipelineOptions options = {});
+
+    BandWriter(int fd, int width, int height, PipelineOptions options = {});
+
+    BandWriter(const BandWriter&) = delete;
+
+    BandWriter& operator=(const BandWriter&) = delete;
+
+    // stops the writer if finish() was not called
+    ~BandWriter();
+
+    // A free band buffer covering the next rows, waiting for the writer
+    // if all of them are queued. nullptr once every row has been handed out.
+    RowBand* next_band();
+
+    // queues a band returned by next_band() for writing
+    void submit(RowBand* band);
+
+    // Waits until everything is written and flushed. Rethrows the first
+    // error the writer hit (e.g. std::system_error from the fd).
+    PipelineStats finish();
+
+    const RenderOptions& render_options() const { return options.render; }
+
+    private:
+    void start();
+
+    void run();
+
+    std::unique_ptr<PpmWriter> writer;
+    int width;
+    int height;
+    PipelineOptions options;
+    int next_row = 0;
+
+    std::vector<RowBand> bands;
+    SpscQueue<RowBand*> to_writer;     // renderer to writer; nullptr means stop
+    SpscQueue<RowBand*> spare;         // writer back to renderer
+    std::thread thread;
+    std::exception_ptr error;
+    bool finished = false;
+    PipelineStats stats;
+    double writer_busy_ms = 0;
+    double writer_stall_ms = 0;
+    std::chrono::steady_clock::time_point started;
+};
+
+// Renders a width x height image with shade(x, y), like render(), and
+// writes it as PPM while it is being rendered. Only queued_bands + 1
+// bands of pixels are held at a time, never the whole image.
+template <typename Shader>
+PipelineStats render_ppm(BandWriter& writer, Shader&& shade) {
+    while (RowBand* band = writer.next_band()) {
+        for_each_tile(band->width, band->y1 - band->y0, [&](const Tile& t) {
+            for (int y = t.y0; y < t.y1; y++) {
+                std::span<Tuple> row = band->row(band->y0 + y);
+                for (int x = t.x0; x < t.x1; x++) {
+                    row[x] = shade(x, band->y0 + y);
+                }
+            }
+        }, writer.render_options());
+        writer.submit(band);
+    }
+    return writer.finish();
+}
+
+template <typename Shader>
+PipelineStats render_ppm(std::ostream& out, int width, int height, 
+    Shader&& shade, PipelineOptions options = {}) {
+    BandWriter writer {out, width, height, options};
+    return render_ppm(writer, shade);
+}
+
+template <typename Shader>
+PipelineStats render_ppm(int fd, int width, int height, 
+    Shader&& shade, PipelineOptions options = {}) {
+    BandWriter writer {fd, width, height, options};
+    return render_ppm(writer, shade);
+}
+
+#endif
@@ -0,0 +1,44 @@
+#include "pixels.h"
+#include <algorithm>
+
+namespace {
+    struct HalfTable {
+        std::uint8_t bytes[65536];
+
+        HalfTable() {
+            for (int h = 0; h < 65536; h++) {
+                bytes[h] = to_byte(from_half(static_cast<std::uint16_t>(h)));
+            }
+        }
+    };
+}
+
+const std::uint8_t* half_byte_table() {
+    static const HalfTable table;
+    return table.bytes;
+}
+
+void to_rgb8(std::span<const Tuple> in, Rgb8* out) {
+    for (const Tuple& p : in) {
+        *out++ = PixelFormat<Rgb8>::encode(p);
+    }
+}
+
+void to_rgb8(std::span<const Rgb8> in, Rgb8* out) {
+    std::copy(in.begin(), in.end(), out);
+}
+
+void to_rgb8(std::span<const Rgb16f> in, Rgb8* out) {
+    const std::uint8_t* bytes = half_byte_table();
+    for (const Rgb16f& p : in) {
+        *out++ = {bytes[p.r], bytes[p.g], bytes[p.b]};
+    }
+}
+
+void to_rgb8(std::span<const Rgb32f> in, Rgb8* out) {
+    for (const Rgb32f& p : in) {
+        *out++ = {static_cast<std::uint8_t>(to_byte(p.r)),
+            static_cast<std::uint8_t>(to_byte(p.g)),
+            static_cast<std::uint8_t>(to_byte(p.b))};
+    }
+}
@@ -0,0 +1,129 @@
+#ifndef PIXELS_H
+#define PIXELS_H
+
+#include <bit>
+#include <cstdint>
+#include <span>
+#include "tuples.h"
+
+// Storage formats for canvas pixels. Colors are converted when a pixel
+// is written and converted back when it is read.
+
+// 8 bits per channel, 0-255; 3 bytes per pixel
+struct Rgb8 {
+    std::uint8_t r, g, b;
+};
+
+// IEEE half floats; 6 bytes per pixel, keeps values above 1
+struct Rgb16f {
+    std::uint16_t r, g, b;
+};
+
+// 12 bytes per pixel, exact
+struct Rgb32f {
+    float r, g, b;
+};
+
+// interpolation 0-1 to 0-255
+inline int to_byte(float c) {
+    int v = static_cast<int>((c * 255) + 0.5f);
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+// float to half, rounding to nearest even
+inline std::uint16_t to_half(float f) {
+    std::uint32_t x = std::bit_cast<std::uint32_t>(f);
+    std::uint32_t sign = (x >> 16) & 0x8000;
+    std::uint32_t a = x & 0x7fffffff;
+
+    if (a >= 0x7f800000) {
+        // infinity stays infinity, NaN stays NaN
+        return sign | 0x7c00 | (a > 0x7f800000 ? 0x200 : 0);
+    }
+    if (a >= 0x477ff000) {
+        // 65520 and above round to infinity
+        return sign | 0x7c00;
+    }
+    if (a < 0x38800000) {
+        // below the smallest normal half: adding 0.5 lines the half's
+        // subnormal step up with the float's last mantissa bit, and the
+        // addition does the rounding
+        float v = std::bit_cast<float>(a) + 0.5f;
+        return sign | (std::bit_cast<std::uint32_t>(v) - 0x3f000000);
+    }
+    // rebias the exponent and round away the 13 dropped mantissa bits
+    std::uint32_t odd = (a >> 13) & 1;
+    a += 0xc8000fff + odd;
+    return sign | (a >> 13);
+}
+
+inline float from_half(std::uint16_t h) {
+    std::uint32_t sign = static_cast<std::uint32_t>(h & 0x8000) << 16;
+    std::uint32_t exponent = (h >> 10) & 0x1f;
+    std::uint32_t mantissa = h & 0x3ff;
+
+    if (exponent == 0) {
+        float v = mantissa * (1.0f / 16777216);     // subnormal, 2^-24 steps
+        return sign ? -v : v;
+    }
+    if (exponent == 31) {
+        return std::bit_cast<float>(sign | 0x7f800000 | (mantissa << 13));
+    }
+    return std::bit_cast<float>(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+// encode() turns a color into the stored pixel, decode() turns it back
+template <typename Pixel>
+struct PixelFormat;
+
+template <>
+struct PixelFormat<Tuple> {
+    static Tuple encode(const Tuple& c) { return c; }
+
+    static Tuple decode(const Tuple& p) { return p; }
+};
+
+template <>
+struct PixelFormat<Rgb8> {
+    static Rgb8 encode(const Tuple& c) {
+        return {static_cast<std::uint8_t>(to_byte(c.x)),
+            static_cast<std::uint8_t>(to_byte(c.y)),
+            static_cast<std::uint8_t>(to_byte(c.z))};
+    }
+
+    static Tuple decode(const Rgb8& p) {
+        return {p.r / 255.0f, p.g / 255.0f, p.b / 255.0f, 0};
+    }
+};
+
+template <>
+struct PixelFormat<Rgb16f> {
+    static Rgb16f encode(const Tuple& c) {
+        return {to_half(c.x), to_half(c.y), to_half(c.z)};
+    }
+
+    static Tuple decode(const Rgb16f& p) {
+        return {from_half(p.r), from_half(p.g), from_half(p.b), 0};
+    }
+};
+
+template <>
+struct PixelFormat<Rgb32f> {
+    static Rgb32f encode(const Tuple& c) { return {c.x, c.y, c.z}; }
+
+    static Tuple decode(const Rgb32f& p) { return {p.r, p.g, p.b, 0}; }
+};
+
+// 0-255 value of every half float, indexed by its bits
+const std::uint8_t* half_byte_table();
+
+// 8-bit copies of a row of pixels, for encoders; out holds in.size() pixels
+void to_rgb8(std::span<const Tuple> in, Rgb8* out);
+
+void to_rgb8(std::span<const Rgb8> in, Rgb8* out);
+
+void to_rgb8(std::span<const Rgb16f> in, Rgb8* out);
+
+void to_rgb8(std::span<const Rgb32f> in, Rgb8* out);
+
+#endif
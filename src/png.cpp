@@ -0,0 +1,227 @@
+#include "png.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "byte_writer.h"
+
+namespace {
+    // slicing-by-8: table[k][b] is the CRC of byte b followed by k zeros
+    struct CrcTable {
+        std::uint32_t table[8][256];
+
+        CrcTable() {
+            for (std::uint32_t b = 0; b < 256; b++) {
+                std::uint32_t c = b;
+                for (int k = 0; k < 8; k++) {
+                    c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+                }
+                table[0][b] = c;
+            }
+            for (int b = 0; b < 256; b++) {
+                for (int k = 1; k < 8; k++) {
+                    std::uint32_t prev = table[k - 1][b];
+                    table[k][b] = (prev >> 8) ^ table[0][prev & 0xff];
+                }
+            }
+        }
+    };
+
+    const CrcTable crc_table;
+
+    const std::uint32_t adler_base = 65521;
+    // most bytes that can be summed before the 32-bit sums could overflow
+    const std::size_t adler_block = 5552;
+    // largest stored deflate block
+    const std::size_t max_block = 65535;
+
+    void put_u32(std::vector<std::uint8_t>& out, std::uint32_t v) {
+        out.push_back(v >> 24);
+        out.push_back(v >> 16);
+        out.push_back(v >> 8);
+        out.push_back(v);
+    }
+
+    // appends a whole chunk: length, type, data and CRC
+    void write_chunk(ByteWriter& out, const char* type, 
+        const std::uint8_t* data, std::size_t size) {
+        std::uint32_t crc = crc32(0, reinterpret_cast<const std::uint8_t*>(type), 4);
+        crc = crc32(crc, data, size);
+        out.put_u32(size);
+        out.write(type, 4);
+        out.write(data, size);
+        out.put_u32(crc);
+    }
+
+    // One band of rows, encoded as a finished IDAT chunk
+    struct Band {
+        std::vector<std::uint8_t> raw;      // filter byte + RGB per row
+        std::vector<std::uint8_t> chunk;
+        std::uint32_t adler;
+    };
+
+    template <typename Pixel>
+    void encode_band(const BasicCanvas<Pixel>& canvas, int y0, int y1, 
+        bool first, Band& band) {
+        TRACE_SCOPE("png band");
+        std::size_t stride = 1 + 3 * static_cast<std::size_t>(canvas.width);
+        band.raw.resize(stride * (y1 - y0));
+        for (int y = y0; y < y1; y++) {
+            std::uint8_t* row = band.raw.data() + stride * (y - y0);
+            row[0] = 0;     // no filter
+            to_rgb8(canvas.row(y), reinterpret_cast<Rgb8*>(row + 1));
+        }
+        band.adler = adler32(1, band.raw.data(), band.raw.size());
+
+        std::size_t blocks = (band.raw.size() + max_block - 1) / max_block;
+        std::vector<std::uint8_t>& c = band.chunk;
+        c.clear();
+        c.reserve(12 + 2 + band.raw.size() + 5 * blocks);
+        put_u32(c, 0);      // length, filled in below
+        c.insert(c.end(), {'I', 'D', 'A', 'T'});
+        if (first) {
+            // zlib header: deflate, 32K window, no preset dictionary
+            c.insert(c.end(), {0x78, 0x01});
+        }
+        for (std::size_t done = 0; done < band.raw.size(); done += max_block) {
+            std::size_t n = std::min(max_block, band.raw.size() - done);
+            // stored block, never the last one
+            c.insert(c.end(), {0x00, std::uint8_t(n), std::uint8_t(n >> 8),
+                std::uint8_t(~n), std::uint8_t(~n >> 8)});
+            c.insert(c.end(), band.raw.begin() + done, band.raw.begin() + done + n);
+        }
+        std::uint32_t length = c.size() - 8;
+        c[0] = length >> 24;
+        c[1] = length >> 16;
+        c[2] = length >> 8;
+        c[3] = length;
+        put_u32(c, crc32(0, c.data() + 4, c.size() - 4));
+    }
+
+    template <typename Pixel>
+    void encode(ByteWriter& out, const BasicCanvas<Pixel>& canvas, 
+        PngOptions options) {
+        TRACE_SCOPE("write_png");
+        static const std::uint8_t signature[8] = 
+            {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+        out.write(signature, sizeof signature);
+
+        std::uint8_t header[13] = {};
+        for (int i = 0; i < 4; i++) {
+            header[i] = static_cast<std::uint32_t>(canvas.width) >> (24 - 8 * i);
+            header[4 + i] = static_cast<std::uint32_t>(canvas.height) >> (24 - 8 * i);
+        }
+        header[8] = 8;      // bits per channel
+        header[9] = 2;      // RGB
+        write_chunk(out, "IHDR", header, sizeof header);
+
+        ThreadPool& pool = options.pool ? *options.pool : ThreadPool::shared();
+        int band_rows = std::max(1, options.band_rows);
+        int band_count = (canvas.height + band_rows - 1) / band_rows;
+        // enough bands in flight to keep every thread busy
+        int group = std::max(1, 2 * pool.size());
+        std::vector<Band> bands(std::min(group, band_count));
+        std::uint32_t adler = 1;
+
+        for (int start = 0; start < band_count; start += group) {
+            int count = std::min(group, band_count - start);
+            pool.parallel_for(count, [&](int i) {
+                int b = start + i;
+                encode_band(canvas, b * band_rows, 
+                    std::min(canvas.height, (b + 1) * band_rows), b == 0, bands[i]);
+            });
+            for (int i = 0; i < count; i++) {
+                out.write(bands[i].chunk.data(), bands[i].chunk.size());
+                adler = adler32_combine(adler, bands[i].adler, bands[i].raw.size());
+            }
+        }
+
+        // an empty final stored block ends the deflate stream
+        std::vector<std::uint8_t> end;
+        if (band_count == 0) end.insert(end.end(), {0x78, 0x01});
+        end.insert(end.end(), {0x01, 0x00, 0x00, 0xff, 0xff});
+        put_u32(end, adler);
+        write_chunk(out, "IDAT", end.data(), end.size());
+        write_chunk(out, "IEND", nullptr, 0);
+        out.flush();
+    }
+}
+
+std::uint32_t crc32(std::uint32_t crc, const std::uint8_t* data, std::size_t size) {
+    const auto& t = crc_table.table;
+    crc = ~crc;
+    for (; size >= 8; size -= 8, data += 8) {
+        std::uint32_t lo = crc ^ (data[0] | data[1] << 8 | data[2] << 16 
+            | static_cast<std::uint32_t>(data[3]) << 24);
+        crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] 
+            ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24]
+            ^ t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+    }
+    for (; size > 0; size--) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xff];
+    }
+    return ~crc;
+}
+
+std::uint32_t adler32(std::uint32_t adler, const std::uint8_t* data, std::size_t size) {
+    std::uint32_t a = adler & 0xffff;
+    std::uint32_t b = adler >> 16;
+    while (size > 0) {
+        std::size_t n = std::min(size, adler_block);
+        size -= n;
+        // 16 bytes at a time: b gains 16 * a plus each byte weighted by
+        // how many of the 16 sums it is part of, which vectorizes
+        for (; n >= 16; n -= 16, data += 16) {
+            std::uint32_t sum = 0, weighted = 0;
+            for (int k = 0; k < 16; k++) {
+                sum += data[k];
+                weighted += (16 - k) * data[k];
+            }
+            b += 16 * a + weighted;
+            a += sum;
+        }
+        for (; n > 0; n--) {
+            a += *data++;
+            b += a;
+        }
+        a %= adler_base;
+        b %= adler_base;
+    }
+    return b << 16 | a;
+}
+
+// same as zlib's adler32_combine
+std::uint32_t adler32_combine(std::uint32_t first, std::uint32_t second, 
+    std::size_t second_size) {
+    std::uint32_t rem = second_size % adler_base;
+    std::uint32_t a = first & 0xffff;
+    std::uint32_t b = static_cast<std::uint64_t>(rem) * a % adler_base;
+    a += (second & 0xffff) + adler_base - 1;
+    b += (first >> 16) + (second >> 16) + adler_base - rem;
+    if (a >= adler_base) a -= adler_base;
+    if (a >= adler_base) a -= adler_base;
+    if (b >= 2 * adler_base) b -= 2 * adler_base;
+    if (b >= adler_base) b -= adler_base;
+    return b << 16 | a;
+}
+
+template <typename Pixel>
+void write_png(std::ostream& out, const BasicCanvas<Pixel>& canvas, 
+    PngOptions options) {
+    ByteWriter writer {out};
+    encode(writer, canvas, options);
+}
+
+template <typename Pixel>
+void write_png(int fd, const BasicCanvas<Pixel>& canvas, PngOptions options) {
+    ByteWriter writer {fd};
+    encode(writer, canvas, options);
+}
+
+template void write_png(std::ostream&, const BasicCanvas<Tuple>&, PngOptions);
+template void write_png(std::ostream&, const BasicCanvas<Rgb8>&, PngOptions);
+template void write_png(std::ostream&, const BasicCanvas<Rgb16f>&, PngOptions);
+template void write_png(std::ostream&, const BasicCanvas<Rgb32f>&, PngOptions);
+template void write_png(int, const BasicCanvas<Tuple>&, PngOptions);
+template void write_png(int, const BasicCanvas<Rgb8>&, PngOptions);
+template void write_png(int, const BasicCanvas<Rgb16f>&, PngOptions);
+template void write_png(int, const BasicCanvas<Rgb32f>&, PngOptions);
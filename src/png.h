@@ -0,0 +1,41 @@
+#ifndef PNG_H
+#define PNG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include "canvas.h"
+#include "thread_pool.h"
+
+struct PngOptions {
+    // rows in one band; bands are encoded in parallel
+    int band_rows = 64;
+    // nullptr uses ThreadPool::shared()
+    ThreadPool* pool = nullptr;
+};
+
+// Writes the canvas as an 8-bit RGB PNG. The image data is kept in
+// stored (uncompressed) deflate blocks, so encoding is little more than
+// copying and checksumming. Each band of rows becomes its own IDAT chunk,
+// built on the pool; the Adler-32 checksums of the bands are combined at
+// the end. Only a few bands are held in memory at a time.
+// Throws std::system_error if writing to the fd fails.
+template <typename Pixel>
+void write_png(std::ostream& out, const BasicCanvas<Pixel>& canvas, 
+    PngOptions options = {});
+
+template <typename Pixel>
+void write_png(int fd, const BasicCanvas<Pixel>& canvas, 
+    PngOptions options = {});
+
+// checksums used by PNG; start crc from 0 and adler from 1
+std::uint32_t crc32(std::uint32_t crc, const std::uint8_t* data, std::size_t size);
+
+std::uint32_t adler32(std::uint32_t adler, const std::uint8_t* data, std::size_t size);
+
+// Adler-32 of two pieces of data joined together, given the checksum of
+// each piece and the size of the second one
+std::uint32_t adler32_combine(std::uint32_t first, std::uint32_t second, 
+    std::size_t second_size);
+
+#endif
@@ -0,0 +1,201 @@
+#include "ppm.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <unistd.h>
+
+namespace {
+    // decimal text of 0-255, so encoding a channel is a table lookup
+    struct ByteText {
+        char digits[3];
+        int length;
+    };
+
+    struct ByteTable {
+        ByteText text[256];
+
+        ByteTable() {
+            for (int v = 0; v < 256; v++) {
+                ByteText& t = text[v];
+                if (v >= 100) {
+                    t = {{char('0' + v / 100), char('0' + v / 10 % 10), 
+                        char('0' + v % 10)}, 3};
+                } else if (v >= 10) {
+                    t = {{char('0' + v / 10), char('0' + v % 10), 0}, 2};
+                } else {
+                    t = {{char('0' + v), 0, 0}, 1};
+                }
+            }
+        }
+    };
+
+    const ByteTable byte_table;
+
+    // the three 0-255 channel values of a pixel
+    struct Channels {
+        int r, g, b;
+    };
+
+    Channels channels(const Tuple& p) {
+        return {to_byte(p.x), to_byte(p.y), to_byte(p.z)};
+    }
+
+    Channels channels(const Rgb8& p) {
+        return {p.r, p.g, p.b};
+    }
+
+    Channels channels(const Rgb16f& p) {
+        const std::uint8_t* bytes = half_byte_table();
+        return {bytes[p.r], bytes[p.g], bytes[p.b]};
+    }
+
+    Channels channels(const Rgb32f& p) {
+        return {to_byte(p.r), to_byte(p.g), to_byte(p.b)};
+    }
+
+    // writes v in decimal, returns the number of characters
+    int format_int(char* out, int v) {
+        char tmp[12];
+        int n = 0;
+        do {
+            tmp[n++] = char('0' + v % 10);
+            v /= 10;
+        } while (v > 0);
+        for (int i = 0; i < n; i++) {
+            out[i] = tmp[n - 1 - i];
+        }
+        return n;
+    }
+}
+
+PpmWriter::PpmWriter(std::ostream& out, PpmFormat format)
+: stream {&out}, format {format}
+{
+}
+
+PpmWriter::PpmWriter(int fd, PpmFormat format)
+: fd {fd}, format {format}
+{
+}
+
+PpmWriter::~PpmWriter() {
+    try {
+        flush();
+    } catch (...) {
+        // destructors must not throw; call flush() to see errors
+    }
+}
+
+void PpmWriter::write_header(int width, int height) {
+    if (used + 64 > capacity) flush();
+
+    char* p = buffer + used;
+    *p++ = 'P';
+    *p++ = format == PpmFormat::P3 ? '3' : '6';
+    *p++ = '\n';
+    p += format_int(p, width);
+    *p++ = ' ';
+    p += format_int(p, height);
+    std::memcpy(p, "\n255\n", 5);
+    p += 5;
+    used = p - buffer;
+    line_length = 0;
+}
+
+template <typename Pixel>
+void PpmWriter::write_pixels(std::span<const Pixel> row) {
+    for (const Pixel& pixel : row) {
+        if (used + max_pixel_bytes > capacity) flush();
+
+        Channels c = channels(pixel);
+        if (format == PpmFormat::P6) {
+            buffer[used++] = static_cast<char>(c.r);
+            buffer[used++] = static_cast<char>(c.g);
+            buffer[used++] = static_cast<char>(c.b);
+        } else {
+            put_channel(c.r);
+            put_channel(c.g);
+            put_channel(c.b);
+        }
+    }
+    end_row();
+}
+
+void PpmWriter::write_row(std::span<const Tuple> row) {
+    write_pixels(row);
+}
+
+void PpmWriter::write_row(std::span<const Rgb8> row) {
+    if (format == PpmFormat::P3) {
+        write_pixels(row);
+        return;
+    }
+    // already in P6 layout
+    static_assert(sizeof(Rgb8) == 3);
+    const char* bytes = reinterpret_cast<const char*>(row.data());
+    std::size_t left = row.size() * 3;
+    while (left > 0) {
+        if (used == capacity) flush();
+        std::size_t n = std::min(left, capacity - used);
+        std::memcpy(buffer + used, bytes, n);
+        used += n;
+        bytes += n;
+        left -= n;
+    }
+}
+
+void PpmWriter::write_row(std::span<const Rgb16f> row) {
+    write_pixels(row);
+}
+
+void PpmWriter::write_row(std::span<const Rgb32f> row) {
+    write_pixels(row);
+}
+
+// appends one P3 value, breaking the line before it would pass 70 characters
+void PpmWriter::put_channel(int v) {
+    const ByteText& t = byte_table.text[v];
+
+    if (line_length > 0) {
+        if (line_length + 1 + t.length > 70) {
+            buffer[used++] = '\n';
+            line_length = 0;
+        } else {
+            buffer[used++] = ' ';
+            line_length++;
+        }
+    }
+    std::memcpy(buffer + used, t.digits, 3);
+    used += t.length;
+    line_length += t.length;
+}
+
+void PpmWriter::end_row() {
+    if (format == PpmFormat::P3) {
+        if (used + 1 > capacity) flush();
+        buffer[used++] = '\n';
+        line_length = 0;
+    }
+}
+
+void PpmWriter::flush() {
+    if (used == 0) return;
+
+    if (stream) {
+        stream->write(buffer, used);
+    } else {
+        std::size_t done = 0;
+        while (done < used) {
+            ssize_t n = ::write(fd, buffer + done, used - done);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                used = 0;
+                throw std::system_error(errno, std::generic_category(), 
+                    "writing PPM data");
+            }
+            done += n;
+        }
+    }
+    used = 0;
+}
@@ -0,0 +1,66 @@
+#ifndef PPM_H
+#define PPM_H
+
+#include <ostream>
+#include <span>
+#include <cstddef>
+#include "tuples.h"
+#include "pixels.h"
+
+enum class PpmFormat {
+    P3,     // ASCII, lines limited to 70 characters
+    P6      // binary, 3 bytes per pixel
+};
+
+// Encodes a PPM image row by row into a fixed-size buffer that is written
+// out to a stream or file descriptor whenever it fills up, so the memory
+// used does not depend on the image size.
+class PpmWriter {
+    public:
+    PpmWriter(std::ostream& out, PpmFormat format = PpmFormat::P3);
+
+    PpmWriter(int fd, PpmFormat format = PpmFormat::P3);
+
+    PpmWriter(const PpmWriter&) = delete;
+
+    PpmWriter& operator=(const PpmWriter&) = delete;
+
+    // flushes whatever is still buffered
+    ~PpmWriter();
+
+    void write_header(int width, int height);
+
+    // one overload per canvas pixel format, each read directly
+    void write_row(std::span<const Tuple> row);
+
+    void write_row(std::span<const Rgb8> row);
+
+    void write_row(std::span<const Rgb16f> row);
+
+    void write_row(std::span<const Rgb32f> row);
+
+    // sends the buffer to the stream / fd.
+    // Throws std::system_error if writing to the fd fails.
+    void flush();
+
+    private:
+    static constexpr std::size_t capacity = 64 * 1024;
+    // upper bound of the bytes one pixel plus a line break can produce
+    static constexpr std::size_t max_pixel_bytes = 16;
+
+    template <typename Pixel>
+    void write_pixels(std::span<const Pixel> row);
+
+    void put_channel(int v);
+
+    void end_row();
+
+    std::ostream* stream = nullptr;
+    int fd = -1;
+    PpmFormat format;
+    int line_length = 0;
+    std::size_t used = 0;
+    char buffer[capacity];
+};
+
+#endif
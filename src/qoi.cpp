@@ -0,0 +1,135 @@
+#include "qoi.h"
+#include <cstdint>
+#include <vector>
+#include "byte_writer.h"
+
+namespace {
+    const std::uint8_t op_index = 0x00;
+    const std::uint8_t op_diff = 0x40;
+    const std::uint8_t op_luma = 0x80;
+    const std::uint8_t op_run = 0xc0;
+    const std::uint8_t op_rgb = 0xfe;
+
+    // alpha is always 255, so it only shows up in the hash
+    int hash(Rgb8 p) {
+        return (p.r * 3 + p.g * 5 + p.b * 7 + 255 * 11) % 64;
+    }
+
+    bool same(Rgb8 a, Rgb8 b) {
+        return a.r == b.r && a.g == b.g && a.b == b.b;
+    }
+
+    // Encoder state carried from one row to the next
+    class QoiEncoder {
+        public:
+        explicit QoiEncoder(ByteWriter& out) : out {out} {}
+
+        void write_header(int width, int height) {
+            out.write("qoif", 4);
+            out.put_u32(width);
+            out.put_u32(height);
+            out.put(3);     // channels
+            out.put(0);     // sRGB with linear alpha
+        }
+
+        void write_row(const Rgb8* row, int width) {
+            for (int x = 0; x < width; x++) {
+                Rgb8 p = row[x];
+                if (same(p, prev)) {
+                    if (++run == 62) end_run();
+                    continue;
+                }
+                end_run();
+
+                int i = hash(p);
+                if (index_valid[i] && same(index[i], p)) {
+                    out.put(op_index | i);
+                } else {
+                    index[i] = p;
+                    index_valid[i] = true;
+                    put_color(p);
+                }
+                prev = p;
+            }
+        }
+
+        void finish() {
+            end_run();
+            static const std::uint8_t padding[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+            out.write(padding, sizeof padding);
+            out.flush();
+        }
+
+        private:
+        void end_run() {
+            if (run > 0) {
+                out.put(op_run | (run - 1));
+                run = 0;
+            }
+        }
+
+        void put_color(Rgb8 p) {
+            // differences wrap around, as in the format
+            int dr = static_cast<std::int8_t>(p.r - prev.r);
+            int dg = static_cast<std::int8_t>(p.g - prev.g);
+            int db = static_cast<std::int8_t>(p.b - prev.b);
+            int dr_dg = dr - dg;
+            int db_dg = db - dg;
+
+            if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                out.put(op_diff | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+            } else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7
+                    && db_dg >= -8 && db_dg <= 7) {
+                out.put(op_luma | (dg + 32));
+                out.put((dr_dg + 8) << 4 | (db_dg + 8));
+            } else {
+                out.put(op_rgb);
+                out.put(p.r);
+                out.put(p.g);
+                out.put(p.b);
+            }
+        }
+
+        ByteWriter& out;
+        // recently seen pixels by hash. The format starts the index out as
+        // transparent black, which no opaque pixel matches.
+        Rgb8 index[64] {};
+        bool index_valid[64] {};
+        Rgb8 prev {0, 0, 0};
+        int run = 0;
+    };
+
+    template <typename Pixel>
+    void encode(ByteWriter& out, const BasicCanvas<Pixel>& canvas) {
+        TRACE_SCOPE("write_qoi");
+        QoiEncoder encoder {out};
+        encoder.write_header(canvas.width, canvas.height);
+        std::vector<Rgb8> row(canvas.width);
+        for (int y = 0; y < canvas.height; y++) {
+            to_rgb8(canvas.row(y), row.data());
+            encoder.write_row(row.data(), canvas.width);
+        }
+        encoder.finish();
+    }
+}
+
+template <typename Pixel>
+void write_qoi(std::ostream& out, const BasicCanvas<Pixel>& canvas) {
+    ByteWriter writer {out};
+    encode(writer, canvas);
+}
+
+template <typename Pixel>
+void write_qoi(int fd, const BasicCanvas<Pixel>& canvas) {
+    ByteWriter writer {fd};
+    encode(writer, canvas);
+}
+
+template void write_qoi(std::ostream&, const BasicCanvas<Tuple>&);
+template void write_qoi(std::ostream&, const BasicCanvas<Rgb8>&);
+template void write_qoi(std::ostream&, const BasicCanvas<Rgb16f>&);
+template void write_qoi(std::ostream&, const BasicCanvas<Rgb32f>&);
+template void write_qoi(int, const BasicCanvas<Tuple>&);
+template void write_qoi(int, const BasicCanvas<Rgb8>&);
+template void write_qoi(int, const BasicCanvas<Rgb16f>&);
+template void write_qoi(int, const BasicCanvas<Rgb32f>&);
@@ -0,0 +1,19 @@
+#ifndef QOI_H
+#define QOI_H
+
+#include <ostream>
+#include "canvas.h"
+
+// Writes the canvas as a QOI image (https://qoiformat.org), 3 channels,
+// sRGB. Lossless at 8 bits per channel and several times faster to
+// encode than PNG. Every pixel depends on the one before, so encoding
+// runs on one thread; rows are converted to 8 bits one at a time, so
+// memory use does not grow with the image.
+// Throws std::system_error if writing to the fd fails.
+template <typename Pixel>
+void write_qoi(std::ostream& out, const BasicCanvas<Pixel>& canvas);
+
+template <typename Pixel>
+void write_qoi(int fd, const BasicCanvas<Pixel>& canvas);
+
+#endif
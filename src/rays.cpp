@@ -0,0 +1,44 @@
+#include "rays.h"
+
+Tuple position(const Ray& r, float t) {
+    return r.origin + r.direction * t;
+}
+
+Ray transform(const Ray& r, const Mat4& m) {
+    return {m * r.origin, m * r.direction};
+}
+
+Ray transform(const Ray& r, const Matrix& m) {
+    return {m * r.origin, m * r.direction};
+}
+
+Ray transform(const Ray& r, const Affine& a) {
+    return {transform_point(a, r.origin), transform_vector(a, r.direction)};
+}
+
+int RayPacket::size() const {
+    return ox.size();
+}
+
+void RayPacket::clear() {
+    ox.clear(); oy.clear(); oz.clear();
+    dx.clear(); dy.clear(); dz.clear();
+}
+
+void RayPacket::resize(int n) {
+    ox.resize(n); oy.resize(n); oz.resize(n);
+    dx.resize(n); dy.resize(n); dz.resize(n);
+}
+
+void RayPacket::push_back(const Ray& r) {
+    ox.push_back(r.origin.x);
+    oy.push_back(r.origin.y);
+    oz.push_back(r.origin.z);
+    dx.push_back(r.direction.x);
+    dy.push_back(r.direction.y);
+    dz.push_back(r.direction.z);
+}
+
+Ray RayPacket::at(int i) const {
+    return {point(ox[i], oy[i], oz[i]), vector(dx[i], dy[i], dz[i])};
+}
@@ -0,0 +1,42 @@
+#ifndef RAYS_H
+#define RAYS_H
+
+#include <vector>
+#include "tuples.h"
+#include "matrices.h"
+#include "affine.h"
+
+struct Ray {
+    Tuple origin;
+    Tuple direction;
+};
+
+// point reached after travelling t along the ray
+Tuple position(const Ray& r, float t);
+
+Ray transform(const Ray& r, const Mat4& m);
+
+Ray transform(const Ray& r, const Matrix& m);
+
+Ray transform(const Ray& r, const Affine& a);
+
+// Rays in structure-of-arrays form, one array per component,
+// so that loops over many rays can be vectorized.
+// Origins are points and directions vectors, so w is not stored.
+struct RayPacket {
+    std::vector<float> ox, oy, oz;
+    std::vector<float> dx, dy, dz;
+
+    int size() const;
+
+    void clear();
+
+    // new rays are left zeroed
+    void resize(int n);
+
+    void push_back(const Ray& r);
+
+    Ray at(int i) const;
+};
+
+#endif
@@ -0,0 +1,31 @@
+#include "render.h"
+#include <algorithm>
+#include "arena.h"
+
+void for_each_tile(int width, int height, 
+    const std::function<void(const Tile&)>& fn, RenderOptions options) {
+    int size = std::max(1, options.tile_size);
+    int tiles_x = (width + size - 1) / size;
+    int tiles_y = (height + size - 1) / size;
+    ThreadPool& pool = options.pool ? *options.pool : ThreadPool::shared();
+    TRACE_SCOPE("for_each_tile");
+
+    pool.parallel_for(tiles_x * tiles_y, [&](int i) {
+        int tx = i % tiles_x;
+        int ty = i / tiles_x;
+        Tile t {tx * size, ty * size, 
+            std::min(width, (tx + 1) * size), std::min(height, (ty + 1) * size)};
+        TRACE_SCOPE("tile");
+        // rewound rather than reset: the caller, or the tile this call is
+        // nested in, may still be using what it allocated before
+        Arena& arena = thread_arena();
+        Arena::Mark start = arena.mark();
+        try {
+            fn(t);
+        } catch (...) {
+            arena.rewind(start);
+            throw;
+        }
+        arena.rewind(start);
+    });
+}
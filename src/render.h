@@ -0,0 +1,79 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <functional>
+#include <span>
+#include "canvas.h"
+#include "mapped_canvas.h"
+#include "tiled_canvas.h"
+#include "thread_pool.h"
+
+// Rectangle of pixels [x0, x1) x [y0, y1)
+struct Tile {
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+};
+
+struct RenderOptions {
+    int tile_size = 16;
+    // nullptr uses ThreadPool::shared()
+    ThreadPool* pool = nullptr;
+};
+
+// Splits a width x height image into tiles and calls fn for each of them
+// on the pool. Tiles never overlap, so fn may write its pixels without
+// locking. thread_arena() is rewound after every tile, so fn can allocate
+// per-ray data from it (e.g. Intersections xs(&thread_arena())) for free;
+// whatever the caller allocated from it before is kept.
+void for_each_tile(int width, int height, 
+    const std::function<void(const Tile&)>& fn, RenderOptions options = {});
+
+// Fills every pixel with shade(x, y), which must be safe to call from
+// several threads. The image does not depend on the number of threads.
+template <typename Pixel, typename Shader>
+void render(BasicCanvas<Pixel>& canvas, Shader&& shade, RenderOptions options = {}) {
+    for_each_tile(canvas.width, canvas.height, [&](const Tile& t) {
+        for (int y = t.y0; y < t.y1; y++) {
+            std::span<Pixel> row = canvas.row(y);
+            for (int x = t.x0; x < t.x1; x++) {
+                row[x] = PixelFormat<Pixel>::encode(shade(x, y));
+            }
+        }
+        // rows are written directly, so count them here
+        TRACE_COUNT(pixels_written, (t.x1 - t.x0) * (t.y1 - t.y0));
+    }, options);
+}
+
+// Same for a tiled canvas. The render tiles are rounded up to whole 8x8
+// canvas tiles so no two threads write to the same one.
+template <typename Pixel, typename Shader>
+void render(TiledCanvas<Pixel>& canvas, Shader&& shade, RenderOptions options = {}) {
+    const int size = TiledCanvas<Pixel>::tile_size;
+    options.tile_size = (std::max(options.tile_size, 1) + size - 1) / size * size;
+    for_each_tile(canvas.width, canvas.height, [&](const Tile& t) {
+        for (int y = t.y0; y < t.y1; y++) {
+            for (int x = t.x0; x < t.x1; x++) {
+                canvas.write_pixel(x, y, shade(x, y));
+            }
+        }
+    }, options);
+}
+
+// Same for a memory-mapped canvas, with the render tiles rounded up to
+// whole canvas tiles so each one touches as few pages as possible.
+template <typename Shader>
+void render(MappedCanvas& canvas, Shader&& shade, RenderOptions options = {}) {
+    const int size = canvas.tile_size;
+    options.tile_size = (std::max(options.tile_size, 1) + size - 1) / size * size;
+    for_each_tile(canvas.width, canvas.height, [&](const Tile& t) {
+        for (int y = t.y0; y < t.y1; y++) {
+            for (int x = t.x0; x < t.x1; x++) {
+                canvas.write_pixel(x, y, shade(x, y));
+            }
+        }
+    }, options);
+}
+
+#endif
@@ -0,0 +1,77 @@
+#include "scene.h"
+#include <stdexcept>
+#include "trace.h"
+
+Scene::Scene() {
+    add_node(-1, matrices::identity4, -1);
+}
+
+NodeId Scene::add_group(NodeId parent, const Mat4& local) {
+    return add_node(parent, local, -1);
+}
+
+NodeId Scene::add_sphere(NodeId parent, const Mat4& local) {
+    NodeId node = add_node(parent, local, static_cast<int>(shapes.size()));
+    shapes.push_back(Sphere {});
+    shape_nodes.push_back(node);
+    return node;
+}
+
+NodeId Scene::add_node(NodeId parent, const Mat4& transform, int shape_index) {
+    if (parent >= size() || (parent >= 0 && !is_group(parent))) {
+        throw std::invalid_argument("scene nodes can only be added to groups");
+    }
+
+    parents.push_back(parent);
+    shape.push_back(shape_index);
+    local.push_back(transform);
+    local_inv.push_back(matrices::identity4);
+    world.push_back(matrices::identity4);
+    world_inv.push_back(matrices::identity4);
+    local_dirty.push_back(1);
+    moved.push_back(0);
+    return size() - 1;
+}
+
+void Scene::set_transform(NodeId node, const Mat4& transform) {
+    local[node] = transform;
+    local_dirty[node] = 1;
+}
+
+// Parents come before their children, so by the time a node is reached
+// its parent's world transform is current and moved[] says whether it
+// changed in this pass.
+SceneUpdateStats Scene::update() {
+    TRACE_SCOPE("Scene::update");
+    stats = {};
+
+    for (NodeId i = 0; i < size(); i++) {
+        NodeId p = parents[i];
+        bool parent_moved = p >= 0 && moved[p];
+        if (!local_dirty[i] && !parent_moved) {
+            moved[i] = 0;
+            stats.reused++;
+            continue;
+        }
+
+        if (local_dirty[i]) {
+            local_inv[i] = inverse(local[i]);
+            local_dirty[i] = 0;
+            stats.inversions++;
+        }
+        if (p < 0) {
+            world[i] = local[i];
+            world_inv[i] = local_inv[i];
+        } else {
+            // (P * L)^-1 = L^-1 * P^-1
+            world[i] = world[p] * local[i];
+            world_inv[i] = local_inv[i] * world_inv[p];
+        }
+        if (shape[i] >= 0) {
+            shapes[shape[i]].transform.set(world[i], world_inv[i]);
+        }
+        moved[i] = 1;
+        stats.recomputed++;
+    }
+    return stats;
+}
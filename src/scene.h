@@ -0,0 +1,96 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <span>
+#include <vector>
+#include "matrices.h"
+#include "spheres.h"
+
+// Index of a node in a Scene
+using NodeId = int;
+
+// What the last Scene::update() did
+struct SceneUpdateStats {
+    // nodes whose world transform was recomputed
+    int recomputed = 0;
+    // nodes whose cached world transform was still valid
+    int reused = 0;
+    // full 4x4 inversions; a node that only moved with its parent gets its
+    // inverse from a multiply instead
+    int inversions = 0;
+};
+
+// Hierarchy of groups and spheres. Every node has a local transform,
+// relative to its parent, and caches its world transform and the
+// inverse of it.
+//
+// Changing a local transform only marks the node; update() then
+// recomputes the marked nodes and everything below them and reuses the
+// rest. Nodes are stored flat in creation order, and a parent is always
+// created before its children, so update() is a single pass over arrays.
+class Scene {
+    public:
+    // the root group, with the identity transform
+    static constexpr NodeId root = 0;
+
+    Scene();
+
+    // Throws std::invalid_argument if parent is not a group.
+    NodeId add_group(NodeId parent, const Mat4& local = matrices::identity4);
+
+    NodeId add_sphere(NodeId parent, const Mat4& local = matrices::identity4);
+
+    void set_transform(NodeId node, const Mat4& local);
+
+    const Mat4& local_transform(NodeId node) const { return local[node]; }
+
+    // as of the last update()
+    const Mat4& world_transform(NodeId node) const { return world[node]; }
+
+    const Mat4& world_inverse(NodeId node) const { return world_inv[node]; }
+
+    NodeId parent(NodeId node) const { return parents[node]; }
+
+    bool is_group(NodeId node) const { return shape[node] < 0; }
+
+    // true if the node changed since the last update()
+    bool dirty(NodeId node) const { return local_dirty[node]; }
+
+    int size() const { return static_cast<int>(parents.size()); }
+
+    // Recomputes the world transforms of changed subtrees, and the
+    // transforms of their spheres.
+    SceneUpdateStats update();
+
+    const SceneUpdateStats& last_update() const { return stats; }
+
+    // Every sphere in world space, with its inverse already cached, as of
+    // the last update(). Ready to intersect or to build a Bvh from; a Bvh
+    // has to be rebuilt after an update() that moved spheres.
+    std::span<const Sphere> spheres() const { return shapes; }
+
+    // the node a sphere from spheres() belongs to
+    NodeId sphere_node(int sphere) const { return shape_nodes[sphere]; }
+
+    private:
+    NodeId add_node(NodeId parent, const Mat4& local, int shape);
+
+    std::vector<NodeId> parents;
+    // index into shapes, -1 for groups
+    std::vector<int> shape;
+    std::vector<Mat4> local;
+    std::vector<Mat4> local_inv;
+    std::vector<Mat4> world;
+    std::vector<Mat4> world_inv;
+    // set by set_transform(), cleared by update(); vector<char> rather
+    // than vector<bool> to keep it a plain byte array
+    std::vector<char> local_dirty;
+    // scratch for update(): the world transform changed this pass
+    std::vector<char> moved;
+
+    std::vector<Sphere> shapes;
+    std::vector<NodeId> shape_nodes;
+    SceneUpdateStats stats;
+};
+
+#endif
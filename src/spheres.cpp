@@ -0,0 +1,116 @@
+#include "spheres.h"
+#include <algorithm>
+#include <limits>
+
+Bounds bounds(const Sphere& s) {
+    return transform(Bounds {point(-1, -1, -1), point(1, 1, 1)}, s.transform.matrix());
+}
+
+Tuple normal_at(const Sphere& s, const Tuple& world_point) {
+    Tuple object_point = s.transform.inverse() * world_point;
+    Tuple object_normal = object_point - point(0, 0, 0);
+    Tuple world_normal = s.transform.inverse_transpose() * object_normal;
+    world_normal.w = 0;
+    return normalize(world_normal);
+}
+
+float closest_t(const Mat4& inverse_transform, const Ray& r) {
+    Ray r2 = transform(r, inverse_transform);
+
+    float a = dot(r2.direction, r2.direction);
+    float b = 2 * (r2.direction.x * r2.origin.x + r2.direction.y * r2.origin.y 
+        + r2.direction.z * r2.origin.z);
+    float c = r2.origin.x * r2.origin.x + r2.origin.y * r2.origin.y 
+        + r2.origin.z * r2.origin.z - 1;
+
+    float discriminant = b * b - 4 * a * c;
+    if (discriminant < 0) return -1;
+
+    float sq = std::sqrt(discriminant);
+    float t0 = (-b - sq) / (2 * a);
+    return t0 >= 0 ? t0 : (-b + sq) / (2 * a);
+}
+
+void intersect(const Sphere& s, const Ray& r, Intersections& xs) {
+    Ray r2 = transform(r, s.transform.inverse());
+
+    // the sphere is centered at the world origin
+    Tuple sphere_to_ray = r2.origin - point(0, 0, 0);
+    float a = dot(r2.direction, r2.direction);
+    float b = 2 * dot(r2.direction, sphere_to_ray);
+    float c = dot(sphere_to_ray, sphere_to_ray) - 1;
+
+    float discriminant = b * b - 4 * a * c;
+    if (discriminant < 0) return;
+
+    float sq = std::sqrt(discriminant);
+    xs.push_back({(-b - sq) / (2 * a), &s});
+    xs.push_back({(-b + sq) / (2 * a), &s});
+}
+
+void intersect(std::span<const Sphere> spheres, const Ray& r, Intersections& xs) {
+    std::size_t first = xs.size();
+    for (const Sphere& s : spheres) {
+        intersect(s, r, xs);
+    }
+    sort_intersections(std::span<Intersection>(xs).subspan(first));
+}
+
+SphereBatch::SphereBatch(std::span<const Sphere> spheres) {
+    inverse_transforms.reserve(spheres.size());
+    for (const Sphere& s : spheres) {
+        inverse_transforms.push_back(s.transform.inverse());
+    }
+}
+
+int SphereBatch::size() const {
+    return inverse_transforms.size();
+}
+
+void intersect(const SphereBatch& spheres, const RayPacket& rays, 
+    std::span<float> t, std::span<int> object) {
+    int n = rays.size();
+    const float* ox = rays.ox.data();
+    const float* oy = rays.oy.data();
+    const float* oz = rays.oz.data();
+    const float* dx = rays.dx.data();
+    const float* dy = rays.dy.data();
+    const float* dz = rays.dz.data();
+    float* t_out = t.data();
+    int* obj_out = object.data();
+
+    std::fill_n(t_out, n, std::numeric_limits<float>::infinity());
+    std::fill_n(obj_out, n, -1);
+
+    for (int s = 0; s < spheres.size(); s++) {
+        // copied into locals so they stay in registers across the ray loop
+        const Mat4& m = spheres.inverse_transforms[s];
+        const float m00 = m[0][0], m01 = m[0][1], m02 = m[0][2], m03 = m[0][3];
+        const float m10 = m[1][0], m11 = m[1][1], m12 = m[1][2], m13 = m[1][3];
+        const float m20 = m[2][0], m21 = m[2][1], m22 = m[2][2], m23 = m[2][3];
+
+        // branch-free so the compiler can vectorize over rays
+        for (int i = 0; i < n; i++) {
+            float lox = m00 * ox[i] + m01 * oy[i] + m02 * oz[i] + m03;
+            float loy = m10 * ox[i] + m11 * oy[i] + m12 * oz[i] + m13;
+            float loz = m20 * ox[i] + m21 * oy[i] + m22 * oz[i] + m23;
+            float ldx = m00 * dx[i] + m01 * dy[i] + m02 * dz[i];
+            float ldy = m10 * dx[i] + m11 * dy[i] + m12 * dz[i];
+            float ldz = m20 * dx[i] + m21 * dy[i] + m22 * dz[i];
+
+            float a = ldx * ldx + ldy * ldy + ldz * ldz;
+            float b = 2 * (ldx * lox + ldy * loy + ldz * loz);
+            float c = lox * lox + loy * loy + loz * loz - 1;
+            float discriminant = b * b - 4 * a * c;
+
+            float sq = std::sqrt(std::max(discriminant, 0.0f));
+            float t0 = (-b - sq) / (2 * a);
+            float t1 = (-b + sq) / (2 * a);
+            float tc = t0 >= 0 ? t0 : t1;
+
+            bool closer = (discriminant >= 0) & (tc >= 0) & (tc < t_out[i]);
+            t_out[i] = closer ? tc : t_out[i];
+            obj_out[i] = closer ? s : obj_out[i];
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef SPHERES_H
+#define SPHERES_H
+
+#include <span>
+#include <vector>
+#include "matrices.h"
+#include "rays.h"
+#include "intersections.h"
+#include "bounds.h"
+#include "cached_transform.h"
+#include "materials.h"
+
+// Unit sphere at the origin, placed in the world by its transform
+struct Sphere {
+    CachedTransform transform;
+    Material material;
+};
+
+// Surface normal at world_point, which must be on the sphere
+Tuple normal_at(const Sphere& s, const Tuple& world_point);
+
+// world-space bounds of the sphere
+Bounds bounds(const Sphere& s);
+
+// Lowest t >= 0 at which r hits the sphere with the given inverse
+// transform, or a negative value on a miss.
+float closest_t(const Mat4& inverse_transform, const Ray& r);
+
+// Appends the (zero or two) intersections of r with s to xs.
+void intersect(const Sphere& s, const Ray& r, Intersections& xs);
+
+// Appends the intersections of r with every sphere, sorted by t.
+void intersect(std::span<const Sphere> spheres, const Ray& r, Intersections& xs);
+
+// Spheres prepared for batched intersection: the inverse transforms are
+// computed once instead of once per ray.
+struct SphereBatch {
+    std::vector<Mat4> inverse_transforms;
+
+    explicit SphereBatch(std::span<const Sphere> spheres);
+
+    int size() const;
+};
+
+// Closest hit of every ray in the packet against every sphere in the
+// batch. For ray i, t[i] is the lowest non-negative t and object[i] the
+// index of the sphere hit, or -1 (and t[i] infinity) on a miss.
+// t and object must hold at least rays.size() elements.
+void intersect(const SphereBatch& spheres, const RayPacket& rays, 
+    std::span<float> t, std::span<int> object);
+
+#endif
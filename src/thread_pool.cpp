@@ -0,0 +1,140 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+// the pool whose task the current thread is running, if any
+static thread_local const ThreadPool* running_pool = nullptr;
+
+ThreadPool::ThreadPool(int n) {
+    if (n <= 0) {
+        n = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // queue 0 belongs to the thread calling parallel_for()
+    for (int i = 0; i < n; i++) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (int i = 1; i < n; i++) {
+        threads.emplace_back(&ThreadPool::worker, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m);
+        stopping = true;
+    }
+    work_cv.notify_all();
+    for (std::thread& t : threads) {
+        t.join();
+    }
+}
+
+int ThreadPool::size() const {
+    return queues.size();
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::parallel_for(int count, const std::function<void(int)>& fn) {
+    if (count <= 0) return;
+
+    // waiting for run_mutex here would wait for ourselves
+    if (running_pool == this) {
+        std::exception_ptr first;
+        for (int i = 0; i < count; i++) {
+            try {
+                fn(i);
+            } catch (...) {
+                if (!first) first = std::current_exception();
+            }
+        }
+        if (first) std::rethrow_exception(first);
+        return;
+    }
+
+    std::lock_guard<std::mutex> run_lock(run_mutex);
+    int n = queues.size();
+    {
+        std::lock_guard<std::mutex> lock(m);
+        job = &fn;
+        error = nullptr;
+        remaining = count;
+
+        // contiguous blocks keep neighbouring tasks on the same thread
+        for (int q = 0; q < n; q++) {
+            std::lock_guard<std::mutex> qlock(queues[q]->m);
+            int begin = static_cast<long>(count) * q / n;
+            int end = static_cast<long>(count) * (q + 1) / n;
+            for (int i = begin; i < end; i++) {
+                queues[q]->tasks.push_back(i);
+            }
+        }
+        generation++;
+    }
+    work_cv.notify_all();
+
+    while (run_one(0)) {}
+
+    std::unique_lock<std::mutex> lock(m);
+    done_cv.wait(lock, [this] { return remaining.load() == 0; });
+    job = nullptr;
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void ThreadPool::worker(int id) {
+    unsigned long seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m);
+            work_cv.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+        }
+        while (run_one(id)) {}
+    }
+}
+
+bool ThreadPool::run_one(int id) {
+    int n = queues.size();
+    int task = -1;
+
+    {
+        Queue& own = *queues[id];
+        std::lock_guard<std::mutex> lock(own.m);
+        if (!own.tasks.empty()) {
+            task = own.tasks.front();
+            own.tasks.pop_front();
+        }
+    }
+    for (int i = 1; task < 0 && i < n; i++) {
+        Queue& victim = *queues[(id + i) % n];
+        std::lock_guard<std::mutex> lock(victim.m);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+        }
+    }
+    if (task < 0) return false;
+
+    // job was set before the task was queued, so it is safe to read here
+    const ThreadPool* outer = running_pool;
+    running_pool = this;
+    try {
+        (*job)(task);
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(m);
+        if (!error) error = std::current_exception();
+    }
+    running_pool = outer;
+
+    if (remaining.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> lock(m);
+        done_cv.notify_all();
+    }
+    return true;
+}
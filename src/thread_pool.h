@@ -0,0 +1,66 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running parallel_for() jobs.
+// Every thread owns a queue of task indices; a thread whose queue runs dry
+// steals from the back of the others, so uneven tasks balance out.
+class ThreadPool {
+    public:
+    // threads counts the caller of parallel_for() too; 0 means one per core
+    explicit ThreadPool(int threads = 0);
+
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const;
+
+    // Calls fn(i) once for every i in [0, count) and returns when all calls
+    // are done. The calling thread takes part. The first exception thrown
+    // by fn is rethrown here after the remaining tasks have finished.
+    // Calls from inside fn (nested parallel_for() on the same pool) run
+    // all of their tasks inline on the calling thread; the pool is busy
+    // with the outer call.
+    void parallel_for(int count, const std::function<void(int)>& fn);
+
+    // pool with one thread per core, created on first use
+    static ThreadPool& shared();
+
+    private:
+    struct Queue {
+        std::mutex m;
+        std::deque<int> tasks;
+    };
+
+    void worker(int id);
+
+    // runs one task from queue id or stolen from another; false if none left
+    bool run_one(int id);
+
+    std::vector<std::thread> threads;
+    std::vector<std::unique_ptr<Queue>> queues;
+
+    std::mutex run_mutex;   // one parallel_for() at a time
+    std::mutex m;
+    std::condition_variable work_cv;
+    std::condition_variable done_cv;
+    const std::function<void(int)>* job = nullptr;
+    unsigned long generation = 0;
+    bool stopping = false;
+    std::atomic<int> remaining {0};
+    std::exception_ptr error;
+};
+
+#endif
@@ -0,0 +1,82 @@
+#include "tiled_canvas.h"
+#include <sstream>
+
+template <typename Pixel>
+TiledCanvas<Pixel>::TiledCanvas(int w, int h) : TiledCanvas(w, h, color(0, 0, 0))
+{
+}
+
+template <typename Pixel>
+TiledCanvas<Pixel>::TiledCanvas(int w, int h, Tuple color)
+: width {w}, height {h}, 
+  tiles_x {(w + tile_size - 1) / tile_size}, 
+  tiles_y {(h + tile_size - 1) / tile_size}
+{
+    pixels = std::vector<Pixel> (static_cast<std::size_t>(tiles_x) * tiles_y 
+        * tile_size * tile_size, PixelFormat<Pixel>::encode(color));
+}
+
+template <typename Pixel>
+std::span<Pixel> TiledCanvas<Pixel>::tile(int tx, int ty) {
+    return {pixels.data() + (static_cast<std::size_t>(ty) * tiles_x + tx) 
+        * tile_size * tile_size, tile_size * tile_size};
+}
+
+template <typename Pixel>
+std::span<const Pixel> TiledCanvas<Pixel>::tile(int tx, int ty) const {
+    return {pixels.data() + (static_cast<std::size_t>(ty) * tiles_x + tx) 
+        * tile_size * tile_size, tile_size * tile_size};
+}
+
+template <typename Pixel>
+void TiledCanvas<Pixel>::read_row(int y, std::span<Pixel> out) const {
+    const Pixel* src = pixels.data() 
+        + static_cast<std::size_t>(y / tile_size) * tiles_x * tile_size * tile_size
+        + morton_y[y % tile_size];
+    int x = 0;
+    // whole tiles: the row's 8 pixels sit at fixed places in each tile
+    for (; x + tile_size <= width; x += tile_size, src += tile_size * tile_size) {
+        for (int i = 0; i < tile_size; i++) {
+            out[x + i] = src[morton_x[i]];
+        }
+    }
+    for (int i = 0; x < width; x++, i++) {
+        out[x] = src[morton_x[i]];
+    }
+}
+
+template <typename Pixel>
+std::string TiledCanvas<Pixel>::to_ppm() const {
+    std::ostringstream out;
+    write_ppm(out, PpmFormat::P3);
+    return out.str();
+}
+
+template <typename Pixel>
+void TiledCanvas<Pixel>::encode(PpmWriter& writer) const {
+    TRACE_SCOPE("write_ppm");
+    writer.write_header(width, height);
+    std::vector<Pixel> row(width);
+    for (int y = 0; y < height; y++) {
+        read_row(y, row);
+        writer.write_row(std::span<const Pixel>(row));
+    }
+    writer.flush();
+}
+
+template <typename Pixel>
+void TiledCanvas<Pixel>::write_ppm(std::ostream& out, PpmFormat format) const {
+    PpmWriter writer {out, format};
+    encode(writer);
+}
+
+template <typename Pixel>
+void TiledCanvas<Pixel>::write_ppm(int fd, PpmFormat format) const {
+    PpmWriter writer {fd, format};
+    encode(writer);
+}
+
+template class TiledCanvas<Tuple>;
+template class TiledCanvas<Rgb8>;
+template class TiledCanvas<Rgb16f>;
+template class TiledCanvas<Rgb32f>;
@@ -0,0 +1,86 @@
+#ifndef TILED_CANVAS_H
+#define TILED_CANVAS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <span>
+#include <string>
+#include <vector>
+#include "tuples.h"
+#include "pixels.h"
+#include "ppm.h"
+#include "trace.h"
+
+// Canvas stored as 8x8 tiles instead of rows. Tiles are kept row by row,
+// and the 64 pixels of a tile in Morton (Z) order, so pixels close to
+// each other in 2D are close in memory too: an 8x8 block of Tuples is
+// 16 cache lines instead of 8 rows far apart. Suits tile-based rendering
+// and filters that look at neighbouring pixels.
+// Instantiated for Tuple, Rgb8, Rgb16f and Rgb32f in tiled_canvas.cpp.
+template <typename Pixel>
+class TiledCanvas {
+    public:
+    static constexpr int tile_size = 8;     // offset() relies on this
+
+    int width;
+    int height;
+
+    TiledCanvas(int w, int h);
+
+    TiledCanvas(int w, int h, Tuple color);
+
+    void write_pixel(int x, int y, Tuple color) {
+        TRACE_COUNT(pixels_written, 1);
+        pixels[offset(x, y)] = PixelFormat<Pixel>::encode(color);
+    }
+
+    Tuple pixel_at(int x, int y) const {
+        return PixelFormat<Pixel>::decode(pixels[offset(x, y)]);
+    }
+
+    // the 64 pixels of tile (tx, ty) in Morton order; see morton()
+    std::span<Pixel> tile(int tx, int ty);
+
+    std::span<const Pixel> tile(int tx, int ty) const;
+
+    // copies row y, left to right, into out (width pixels)
+    void read_row(int y, std::span<Pixel> out) const;
+
+    // position of pixel (x, y) of a tile within the tile, 0-63
+    static int morton(int x, int y) {
+        return morton_x[x] | morton_y[y];
+    }
+
+    std::string to_ppm() const;
+
+    void write_ppm(std::ostream& out, PpmFormat format = PpmFormat::P3) const;
+
+    void write_ppm(int fd, PpmFormat format = PpmFormat::P3) const;
+
+    private:
+    // the bits of x and y interleaved: x in the even bits, y in the odd
+    static constexpr std::uint8_t morton_x[8] = {0, 1, 4, 5, 16, 17, 20, 21};
+    static constexpr std::uint8_t morton_y[8] = {0, 2, 8, 10, 32, 34, 40, 42};
+
+    // shifts and masks rather than / and %, which are slower on signed ints
+    std::size_t offset(int x, int y) const {
+        unsigned ux = x, uy = y;
+        std::size_t t = static_cast<std::size_t>(uy >> 3) * tiles_x + (ux >> 3);
+        return t << 6 | morton(ux & 7, uy & 7);
+    }
+
+    void encode(PpmWriter& writer) const;
+
+    int tiles_x;
+    int tiles_y;
+    // edge tiles are padded to the full 8x8
+    std::vector<Pixel> pixels;
+};
+
+extern template class TiledCanvas<Tuple>;
+extern template class TiledCanvas<Rgb8>;
+extern template class TiledCanvas<Rgb16f>;
+extern template class TiledCanvas<Rgb32f>;
+
+#endif
@@ -1,9 +1,9 @@
 #include "tools.h"
 
 bool equal (float a, float b) {
-    if (abs(a - b) < 0.00001) {
-        return true;
-    } else {
-        return false;
-    }
-}
\ No newline at end of file
+    return std::abs(a - b) < Precision<float>::epsilon;
+}
+
+bool equal (double a, double b) {
+    return std::abs(a - b) < Precision<double>::epsilon;
+}
@@ -2,7 +2,35 @@
 #define TOOLS_H
 
 #include "cmath"
+#include "type_traits"
+
+// Tolerance for comparing results computed at each precision. float
+// keeps about 7 significant digits, double about 16, so double can
+// resolve far smaller differences, e.g. on scenes with large coordinates.
+template <typename T>
+struct Precision;
+
+template <>
+struct Precision<float> {
+    static constexpr float epsilon = 0.0001f;
+};
+
+template <>
+struct Precision<double> {
+    static constexpr double epsilon = 0.00000001;
+};
 
 bool equal (float a, float b);
 
-#endif
\ No newline at end of file
+bool equal (double a, double b);
+
+// Mixed arguments, e.g. a float result against a double or integer
+// constant, are compared at float precision if either side is a float.
+template <typename A, typename B>
+bool equal (A a, B b) {
+    using T = std::conditional_t<std::is_same_v<A, float> || std::is_same_v<B, float>, 
+        float, double>;
+    return equal(static_cast<T>(a), static_cast<T>(b));
+}
+
+#endif
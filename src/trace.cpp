@@ -0,0 +1,205 @@
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace trace {
+
+namespace {
+    struct Event {
+        const char* name;
+        std::uint64_t start;
+        std::uint64_t end;
+    };
+
+    // Written only by its own thread. size is published with release
+    // stores so a reader sees complete events.
+    struct ThreadBuffer {
+        static constexpr std::size_t capacity = 1 << 16;
+
+        int tid;
+        std::unique_ptr<Event[]> events {new Event[capacity]};
+        std::atomic<std::size_t> size {0};
+        std::atomic<std::uint64_t> dropped {0};
+        std::atomic<std::uint64_t> counters[counter_count] {};
+    };
+
+    // Buffers are kept after their thread exits, so a pool that has shut
+    // down can still be read back.
+    struct Registry {
+        std::mutex m;
+        std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    };
+
+    Registry& registry() {
+        static Registry r;
+        return r;
+    }
+
+    ThreadBuffer& local_buffer() {
+        thread_local ThreadBuffer* buffer = nullptr;
+        if (!buffer) {
+            Registry& r = registry();
+            std::lock_guard<std::mutex> lock {r.m};
+            r.buffers.push_back(std::make_unique<ThreadBuffer>());
+            buffer = r.buffers.back().get();
+            buffer->tid = r.buffers.size();
+        }
+        return *buffer;
+    }
+
+    // only the owning thread writes, so no read-modify-write is needed
+    void add(std::atomic<std::uint64_t>& a, std::uint64_t n) {
+        a.store(a.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    void write_json_string(std::ostream& out, const char* s) {
+        out << '"';
+        for (; *s; s++) {
+            if (*s == '"' || *s == '\\') out << '\\';
+            out << *s;
+        }
+        out << '"';
+    }
+
+    const char* const counter_names[counter_count] = {
+        "inversions", "matrix_multiplies", "pixels_written"
+    };
+}
+
+const char* counter_name(Counter c) {
+    return counter_names[static_cast<int>(c)];
+}
+
+std::uint64_t now_ns() {
+    using clock = std::chrono::steady_clock;
+    static const clock::time_point epoch = clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        clock::now() - epoch).count();
+}
+
+void record(const char* name, std::uint64_t start_ns, std::uint64_t end_ns) {
+    ThreadBuffer& b = local_buffer();
+    std::size_t n = b.size.load(std::memory_order_relaxed);
+    if (n == ThreadBuffer::capacity) {
+        add(b.dropped, 1);
+        return;
+    }
+    b.events[n] = {name, start_ns, end_ns};
+    b.size.store(n + 1, std::memory_order_release);
+}
+
+void count(Counter c, std::uint64_t n) {
+    add(local_buffer().counters[static_cast<int>(c)], n);
+}
+
+std::array<std::uint64_t, counter_count> counters() {
+    std::array<std::uint64_t, counter_count> totals {};
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock {r.m};
+    for (const auto& b : r.buffers) {
+        for (int i = 0; i < counter_count; i++) {
+            totals[i] += b->counters[i].load(std::memory_order_relaxed);
+        }
+    }
+    return totals;
+}
+
+std::uint64_t event_count() {
+    std::uint64_t n = 0;
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock {r.m};
+    for (const auto& b : r.buffers) n += b->size.load(std::memory_order_acquire);
+    return n;
+}
+
+std::uint64_t dropped_count() {
+    std::uint64_t n = 0;
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock {r.m};
+    for (const auto& b : r.buffers) n += b->dropped.load(std::memory_order_relaxed);
+    return n;
+}
+
+void write_chrome_json(std::ostream& out) {
+    std::array<std::uint64_t, counter_count> totals = counters();
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock {r.m};
+
+    out << "{\"traceEvents\": [\n";
+    bool first = true;
+    std::uint64_t last_end = 0;
+    for (const auto& b : r.buffers) {
+        std::size_t n = b->size.load(std::memory_order_acquire);
+        for (std::size_t i = 0; i < n; i++) {
+            const Event& e = b->events[i];
+            out << (first ? "  " : ",\n  ") << "{\"name\": ";
+            write_json_string(out, e.name);
+            // timestamps are in microseconds
+            out << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << b->tid
+                << ", \"ts\": " << e.start / 1000.0 
+                << ", \"dur\": " << (e.end - e.start) / 1000.0 << "}";
+            first = false;
+            last_end = std::max(last_end, e.end);
+        }
+    }
+    // counter totals as one sample at the end of the trace
+    out << (first ? "  " : ",\n  ") << "{\"name\": \"counters\", \"ph\": \"C\", "
+        << "\"pid\": 1, \"ts\": " << last_end / 1000.0 << ", \"args\": {";
+    for (int i = 0; i < counter_count; i++) {
+        out << (i ? ", " : "") << '"' << counter_names[i] << "\": " << totals[i];
+    }
+    out << "}}\n], \"displayTimeUnit\": \"ns\"}\n";
+}
+
+void write_summary(std::ostream& out) {
+    struct Total {
+        std::uint64_t calls = 0;
+        std::uint64_t ns = 0;
+        std::uint64_t max_ns = 0;
+    };
+    std::map<std::string, Total> totals;
+    std::uint64_t dropped = 0;
+    {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock {r.m};
+        for (const auto& b : r.buffers) {
+            std::size_t n = b->size.load(std::memory_order_acquire);
+            for (std::size_t i = 0; i < n; i++) {
+                const Event& e = b->events[i];
+                Total& t = totals[e.name];
+                t.calls++;
+                t.ns += e.end - e.start;
+                t.max_ns = std::max(t.max_ns, e.end - e.start);
+            }
+            dropped += b->dropped.load(std::memory_order_relaxed);
+        }
+    }
+
+    for (const auto& [name, t] : totals) {
+        out << name << ": " << t.calls << " calls, " << t.ns / 1e6 << " ms total, "
+            << t.max_ns / 1e6 << " ms max\n";
+    }
+    std::array<std::uint64_t, counter_count> c = counters();
+    for (int i = 0; i < counter_count; i++) {
+        out << counter_names[i] << ": " << c[i] << "\n";
+    }
+    if (dropped > 0) out << "dropped events: " << dropped << "\n";
+}
+
+void clear() {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock {r.m};
+    for (const auto& b : r.buffers) {
+        b->size.store(0, std::memory_order_relaxed);
+        b->dropped.store(0, std::memory_order_relaxed);
+        for (auto& c : b->counters) c.store(0, std::memory_order_relaxed);
+    }
+}
+
+}
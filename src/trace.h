@@ -0,0 +1,86 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+
+// Scoped timing and event counters for the hot paths.
+//
+// TRACE_SCOPE("name") times the rest of the enclosing block and
+// TRACE_COUNT(counter, n) adds n to a counter. Both compile to nothing
+// unless RAY_TRACER_TRACING is defined (cmake -DRAY_TRACER_TRACING=ON).
+//
+// Every thread records into its own buffer, so recording takes no locks
+// and no atomic read-modify-writes. Read the results with
+// write_chrome_json() (load it in chrome://tracing or ui.perfetto.dev),
+// write_summary() or counters() once the traced work has finished.
+namespace trace {
+
+enum class Counter {
+    inversions,
+    matrix_multiplies,
+    pixels_written,
+    count
+};
+
+constexpr int counter_count = static_cast<int>(Counter::count);
+
+const char* counter_name(Counter c);
+
+// nanoseconds since the first call
+std::uint64_t now_ns();
+
+// name must outlive the trace, e.g. a string literal
+void record(const char* name, std::uint64_t start_ns, std::uint64_t end_ns);
+
+void count(Counter c, std::uint64_t n = 1);
+
+// records the time from construction to destruction
+class Scope {
+    public:
+    explicit Scope(const char* name) : name {name}, start {now_ns()} {}
+
+    ~Scope() { record(name, start, now_ns()); }
+
+    Scope(const Scope&) = delete;
+
+    Scope& operator=(const Scope&) = delete;
+
+    private:
+    const char* name;
+    std::uint64_t start;
+};
+
+// totals over all threads, indexed by Counter
+std::array<std::uint64_t, counter_count> counters();
+
+// events recorded so far, and those dropped because a buffer was full
+std::uint64_t event_count();
+
+std::uint64_t dropped_count();
+
+// Chrome trace event JSON: one complete ("X") event per scope, one
+// thread id per recording thread, and the counter totals
+void write_chrome_json(std::ostream& out);
+
+// calls and total / max time per scope name, then the counters
+void write_summary(std::ostream& out);
+
+// forgets all events and counters; nothing may be recording meanwhile
+void clear();
+
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#ifdef RAY_TRACER_TRACING
+#define TRACE_SCOPE(name) trace::Scope TRACE_CONCAT(trace_scope_, __LINE__) {name}
+#define TRACE_COUNT(counter, n) trace::count(trace::Counter::counter, n)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_COUNT(counter, n) ((void)0)
+#endif
+
+#endif
@@ -1,18 +1,188 @@
 #ifndef TRANSFORMATIONS_H
 #define TRANSFORMATIONS_H
 
+#include <cmath>
+#include <type_traits>
 #include "matrices.h"
 
-Matrix translation(float x, float y, float z);
+// The builders are constexpr: with constant arguments the matrix is
+// computed by the compiler, e.g.
+//   constexpr Mat4 m = rotation_x(M_PI / 2);
+// They build a float Mat4 unless asked for another precision:
+//   Mat4D m = translation<double>(1e6, 0, 0);
 
-Matrix scaling(float x, float y, float z);
+namespace transformations_detail {
+    constexpr double pi = 3.14159265358979323846;
 
-Matrix rotation_x(float r);
+    // Taylor series after reducing r to [-pi, pi]; only used at compile
+    // time, at run time the std versions are called.
+    constexpr double sin_series(double r) {
+        double turns = r / (2 * pi);
+        long n = static_cast<long>(turns < 0 ? turns - 0.5 : turns + 0.5);
+        double x = r - n * 2 * pi;
 
-Matrix rotation_y(float r);
+        double term = x, sum = x;
+        for (int i = 1; i < 12; i++) {
+            term *= -x * x / ((2 * i) * (2 * i + 1));
+            sum += term;
+        }
+        return sum;
+    }
 
-Matrix rotation_z(float r);
+    template <typename T>
+    constexpr T sin(T r) {
+        if (std::is_constant_evaluated()) {
+            return static_cast<T>(sin_series(r));
+        }
+        return std::sin(r);
+    }
 
-Matrix shearing(float x_y, float x_z, float y_x, float y_z, float z_x, float z_y);
+    template <typename T>
+    constexpr T cos(T r) {
+        if (std::is_constant_evaluated()) {
+            return static_cast<T>(sin_series(r + pi / 2));
+        }
+        return std::cos(r);
+    }
+}
 
-#endif
\ No newline at end of file
+template <typename T = float>
+constexpr BasicMat4<T> translation(Scalar<T> x, Scalar<T> y, Scalar<T> z) {
+    return {{{1, 0, 0, x},
+             {0, 1, 0, y},
+             {0, 0, 1, z},
+             {0, 0, 0, 1}}};
+}
+
+template <typename T = float>
+constexpr BasicMat4<T> scaling(Scalar<T> x, Scalar<T> y, Scalar<T> z) {
+    return {{{x, 0, 0, 0},
+             {0, y, 0, 0},
+             {0, 0, z, 0},
+             {0, 0, 0, 1}}};
+}
+
+template <typename T = float>
+constexpr BasicMat4<T> rotation_x(Scalar<T> r) {
+    T c = transformations_detail::cos<T>(r);
+    T s = transformations_detail::sin<T>(r);
+    return {{{1, 0, 0, 0},
+             {0, c, -s, 0},
+             {0, s, c, 0},
+             {0, 0, 0, 1}}};
+}
+
+template <typename T = float>
+constexpr BasicMat4<T> rotation_y(Scalar<T> r) {
+    T c = transformations_detail::cos<T>(r);
+    T s = transformations_detail::sin<T>(r);
+    return {{{c, 0, s, 0},
+             {0, 1, 0, 0},
+             {-s, 0, c, 0},
+             {0, 0, 0, 1}}};
+}
+
+template <typename T = float>
+constexpr BasicMat4<T> rotation_z(Scalar<T> r) {
+    T c = transformations_detail::cos<T>(r);
+    T s = transformations_detail::sin<T>(r);
+    return {{{c, -s, 0, 0},
+             {s, c, 0, 0},
+             {0, 0, 1, 0},
+             {0, 0, 0, 1}}};
+}
+
+template <typename T = float>
+constexpr BasicMat4<T> shearing(Scalar<T> x_y, Scalar<T> x_z, Scalar<T> y_x, Scalar<T> y_z, Scalar<T> z_x, Scalar<T> z_y) {
+    return {{{1, x_y, x_z, 0},
+             {y_x, 1, y_z, 0},
+             {z_x, z_y, 1, 0},
+             {0, 0, 0, 1}}};
+}
+
+// Transformations listed in the order they are applied:
+//   TransformChain().rotate_x(r).scale(5, 5, 5).translate(10, 5, 7)
+// is translation(10, 5, 7) * scaling(5, 5, 5) * rotation_x(r).
+// Each step updates only the rows it changes instead of doing a full 4x4
+// multiply, and a chain with constant arguments folds into one constant
+// matrix.
+template <typename T>
+class BasicTransformChain {
+    public:
+    constexpr BasicTransformChain() = default;
+
+    constexpr explicit BasicTransformChain(const BasicMat4<T>& start) : m {start} {}
+
+    constexpr BasicTransformChain translate(T x, T y, T z) const {
+        BasicTransformChain res = *this;
+        for (int j = 0; j < 4; j++) {
+            res.m[0][j] += x * m[3][j];
+            res.m[1][j] += y * m[3][j];
+            res.m[2][j] += z * m[3][j];
+        }
+        return res;
+    }
+
+    constexpr BasicTransformChain scale(T x, T y, T z) const {
+        BasicTransformChain res = *this;
+        for (int j = 0; j < 4; j++) {
+            res.m[0][j] *= x;
+            res.m[1][j] *= y;
+            res.m[2][j] *= z;
+        }
+        return res;
+    }
+
+    constexpr BasicTransformChain rotate_x(T r) const {
+        return rotated(1, 2, r);
+    }
+
+    constexpr BasicTransformChain rotate_y(T r) const {
+        return rotated(2, 0, r);
+    }
+
+    constexpr BasicTransformChain rotate_z(T r) const {
+        return rotated(0, 1, r);
+    }
+
+    constexpr BasicTransformChain shear(T x_y, T x_z, T y_x, 
+        T y_z, T z_x, T z_y) const {
+        BasicTransformChain res = *this;
+        for (int j = 0; j < 4; j++) {
+            res.m[0][j] = m[0][j] + x_y * m[1][j] + x_z * m[2][j];
+            res.m[1][j] = y_x * m[0][j] + m[1][j] + y_z * m[2][j];
+            res.m[2][j] = z_x * m[0][j] + z_y * m[1][j] + m[2][j];
+        }
+        return res;
+    }
+
+    // any other transformation
+    constexpr BasicTransformChain then(const BasicMat4<T>& t) const {
+        return BasicTransformChain(t * m);
+    }
+
+    constexpr const BasicMat4<T>& matrix() const { return m; }
+
+    constexpr operator BasicMat4<T>() const { return m; }
+
+    private:
+    // rotation mixing rows a and b, with b = a + 1 in the x -> y -> z cycle
+    constexpr BasicTransformChain rotated(int a, int b, T r) const {
+        T c = transformations_detail::cos<T>(r);
+        T s = transformations_detail::sin<T>(r);
+        BasicTransformChain res = *this;
+        for (int j = 0; j < 4; j++) {
+            res.m[a][j] = c * m[a][j] - s * m[b][j];
+            res.m[b][j] = s * m[a][j] + c * m[b][j];
+        }
+        return res;
+    }
+
+    BasicMat4<T> m = matrices::basic_identity4<T>;
+};
+
+using TransformChain = BasicTransformChain<float>;
+
+using TransformChainD = BasicTransformChain<double>;
+
+#endif
@@ -0,0 +1,136 @@
+#include "tuple_batch.h"
+#include <algorithm>
+#include "cpu.h"
+
+#ifdef RAY_TRACER_AVX2
+#include <immintrin.h>
+#endif
+
+int TupleBatch::size() const {
+    return x.size();
+}
+
+void TupleBatch::resize(int n) {
+    x.resize(n); y.resize(n); z.resize(n); w.resize(n);
+}
+
+void TupleBatch::clear() {
+    x.clear(); y.clear(); z.clear(); w.clear();
+}
+
+void TupleBatch::push_back(const Tuple& t) {
+    x.push_back(t.x);
+    y.push_back(t.y);
+    z.push_back(t.z);
+    w.push_back(t.w);
+}
+
+Tuple TupleBatch::at(int i) const {
+    return {x[i], y[i], z[i], w[i]};
+}
+
+namespace {
+
+struct Arrays {
+    const float* x;
+    const float* y;
+    const float* z;
+    const float* w;
+    float* ox;
+    float* oy;
+    float* oz;
+    float* ow;
+};
+
+// every output is computed before any is stored, so in-place works
+void transform_scalar(const Mat4& m, const Arrays& a, int begin, int end) {
+    for (int i = begin; i < end; i++) {
+        float x = a.x[i], y = a.y[i], z = a.z[i], w = a.w[i];
+        float rx = m[0][0] * x + m[0][1] * y + m[0][2] * z + m[0][3] * w;
+        float ry = m[1][0] * x + m[1][1] * y + m[1][2] * z + m[1][3] * w;
+        float rz = m[2][0] * x + m[2][1] * y + m[2][2] * z + m[2][3] * w;
+        float rw = m[3][0] * x + m[3][1] * y + m[3][2] * z + m[3][3] * w;
+        a.ox[i] = rx;
+        a.oy[i] = ry;
+        a.oz[i] = rz;
+        a.ow[i] = rw;
+    }
+}
+
+#ifdef RAY_TRACER_AVX2
+// Eight tuples per iteration, with the 16 matrix entries broadcast into
+// registers once.
+__attribute__((target("avx2,fma")))
+void transform_avx2(const Mat4& m, const Arrays& a, int begin, int end) {
+    __m256 c[4][4];
+    for (int r = 0; r < 4; r++) {
+        for (int k = 0; k < 4; k++) c[r][k] = _mm256_set1_ps(m[r][k]);
+    }
+
+    int i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 x = _mm256_loadu_ps(a.x + i);
+        __m256 y = _mm256_loadu_ps(a.y + i);
+        __m256 z = _mm256_loadu_ps(a.z + i);
+        __m256 w = _mm256_loadu_ps(a.w + i);
+        __m256 res[4];
+        for (int r = 0; r < 4; r++) {
+            __m256 v = _mm256_mul_ps(c[r][0], x);
+            v = _mm256_fmadd_ps(c[r][1], y, v);
+            v = _mm256_fmadd_ps(c[r][2], z, v);
+            res[r] = _mm256_fmadd_ps(c[r][3], w, v);
+        }
+        _mm256_storeu_ps(a.ox + i, res[0]);
+        _mm256_storeu_ps(a.oy + i, res[1]);
+        _mm256_storeu_ps(a.oz + i, res[2]);
+        _mm256_storeu_ps(a.ow + i, res[3]);
+    }
+    transform_scalar(m, a, i, end);
+}
+#endif
+
+void transform_range(const Mat4& m, const Arrays& a, int begin, int end) {
+#ifdef RAY_TRACER_AVX2
+    if (cpu_has_avx2()) {
+        transform_avx2(m, a, begin, end);
+        return;
+    }
+#endif
+    transform_scalar(m, a, begin, end);
+}
+
+// tuples per parallel task; a multiple of the vector width
+const int chunk_size = 1 << 15;
+
+}
+
+bool batch_uses_avx2() {
+    return cpu_has_avx2();
+}
+
+void transform(const Mat4& m, int n,
+    const float* x, const float* y, const float* z, const float* w,
+    float* out_x, float* out_y, float* out_z, float* out_w,
+    BatchOptions options) {
+    Arrays a {x, y, z, w, out_x, out_y, out_z, out_w};
+
+    if (n < options.parallel_threshold || n <= chunk_size) {
+        transform_range(m, a, 0, n);
+        return;
+    }
+
+    ThreadPool& pool = options.pool ? *options.pool : ThreadPool::shared();
+    int chunks = (n + chunk_size - 1) / chunk_size;
+    pool.parallel_for(chunks, [&](int c) {
+        int begin = c * chunk_size;
+        transform_range(m, a, begin, std::min(n, begin + chunk_size));
+    });
+}
+
+void transform(const Mat4& m, const TupleBatch& in, TupleBatch& out,
+    BatchOptions options) {
+    int n = in.size();
+    if (&out != &in) out.resize(n);
+    transform(m, n, in.x.data(), in.y.data(), in.z.data(), in.w.data(),
+        out.x.data(), out.y.data(), out.z.data(), out.w.data(), options);
+}
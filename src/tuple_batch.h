@@ -0,0 +1,47 @@
+#ifndef TUPLE_BATCH_H
+#define TUPLE_BATCH_H
+
+#include <vector>
+#include "tuples.h"
+#include "matrices.h"
+#include "thread_pool.h"
+
+// Tuples in structure-of-arrays form, one array per component, for
+// transforming many points or vectors (mesh vertices, normals) at once.
+struct TupleBatch {
+    std::vector<float> x, y, z, w;
+
+    int size() const;
+
+    void resize(int n);
+
+    void clear();
+
+    void push_back(const Tuple& t);
+
+    Tuple at(int i) const;
+};
+
+struct BatchOptions {
+    // batches with fewer tuples than this run on the calling thread
+    int parallel_threshold = 1 << 18;
+    // nullptr uses ThreadPool::shared()
+    ThreadPool* pool = nullptr;
+};
+
+// out[i] = m * in[i] for every tuple. out is resized to match in and may
+// be the same batch. Uses AVX2 when the CPU supports it and splits large
+// batches across the pool.
+void transform(const Mat4& m, const TupleBatch& in, TupleBatch& out,
+    BatchOptions options = {});
+
+// same on raw arrays of n floats each; outputs may alias the inputs
+void transform(const Mat4& m, int n,
+    const float* x, const float* y, const float* z, const float* w,
+    float* out_x, float* out_y, float* out_z, float* out_w,
+    BatchOptions options = {});
+
+// true when transform() runs the AVX2 kernel on this machine
+bool batch_uses_avx2();
+
+#endif
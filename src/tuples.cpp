@@ -1,85 +1,130 @@
 #include "tuples.h"
+#include "tuples_simd.h"
 
-bool Tuple::isPoint() {
+// simd:: has the SSE kernels for float and the scalar templates for
+// double, so the same code serves both precisions.
+
+template <typename T>
+bool BasicTuple<T>::isPoint() {
     if (w == 1) return true;
     return false;
 }
 
-bool Tuple::isVector() {
+template <typename T>
+bool BasicTuple<T>::isVector() {
     if (w == 0) return true;
     return false;
 }
 
-bool operator== (const Tuple& t1, const Tuple& t2) {
+template <typename T>
+bool operator== (const BasicTuple<T>& t1, const BasicTuple<T>& t2) {
     return equal(t1.x, t2.x) && equal(t1.y, t2.y) 
         && equal(t1.z, t2.z) && equal(t1.w, t2.w);
 }
 
-bool operator!= (const Tuple& t1, const Tuple& t2) {
+template <typename T>
+bool operator!= (const BasicTuple<T>& t1, const BasicTuple<T>& t2) {
     return !equal(t1.x, t2.x) || !equal(t1.y, t2.y) 
         || !equal(t1.z, t2.z) || !equal(t1.w, t2.w);
 }
 
 // is it the user's responsibility to guarantee not to add two points?
-Tuple operator+ (const Tuple& t1, const Tuple& t2) {
-    return {t1.x + t2.x, t1.y + t2.y, t1.z + t2.z, t1.w + t2.w};
+template <typename T>
+BasicTuple<T> operator+ (const BasicTuple<T>& t1, const BasicTuple<T>& t2) {
+    return simd::add(t1, t2);
 }
 
 // Should not subtract point from vector
-Tuple operator- (const Tuple& t1, const Tuple& t2) {
-    return {t1.x - t2.x, t1.y - t2.y, t1.z - t2.z, t1.w - t2.w};
+template <typename T>
+BasicTuple<T> operator- (const BasicTuple<T>& t1, const BasicTuple<T>& t2) {
+    return simd::sub(t1, t2);
 }
 
-Tuple Tuple::operator- () const {
-    return {-x, -y, -z, -w};
+template <typename T>
+BasicTuple<T> BasicTuple<T>::operator- () const {
+    return simd::neg(*this);
 }
 
-Tuple operator* (const Tuple& t, const float s) {
-    return {t.x * s, t.y * s, t.z * s, t.w * s};
+template <typename T>
+BasicTuple<T> operator* (const BasicTuple<T>& t, const Scalar<T> s) {
+    return simd::mul(t, s);
 }
 
-Tuple operator* (const float s, const Tuple& t) {
-    return {t.x * s, t.y * s, t.z * s, t.w * s};
+template <typename T>
+BasicTuple<T> operator* (const Scalar<T> s, const BasicTuple<T>& t) {
+    return simd::mul(t, s);
 }
 
 // check for s == 0
-Tuple operator/ (const Tuple& t, const float s) {
-    return {t.x / s, t.y / s, t.z / s, t.w / s};
+template <typename T>
+BasicTuple<T> operator/ (const BasicTuple<T>& t, const Scalar<T> s) {
+    return simd::div(t, s);
 }
 
-Tuple point(float x, float y, float z) {
+template <typename T>
+BasicTuple<T> point(Scalar<T> x, Scalar<T> y, Scalar<T> z) {
     return {x, y, z, 1.0};
 }
 
-Tuple vector(float x, float y, float z) {
+template <typename T>
+BasicTuple<T> vector(Scalar<T> x, Scalar<T> y, Scalar<T> z) {
     return {x, y, z, 0.0};
 }
 
-Tuple color(float x, float y, float z) {
+template <typename T>
+BasicTuple<T> color(Scalar<T> x, Scalar<T> y, Scalar<T> z) {
     return {x, y, z, 0.0};
 }
 
-float Tuple::magnitude() const {
-    return std::sqrt(x * x + y * y + z * z + w * w);
+template <typename T>
+T BasicTuple<T>::magnitude() const {
+    return std::sqrt(simd::dot(*this, *this));
 }
 
 // maybe modify tuple instead of returning a new one?
 // check if magnitude(t) != 0?
-Tuple normalize(const Tuple& t) {
-    float m = t.magnitude();
-    return {t.x / m, t.y / m, t.z / m, t.w / m};
+template <typename T>
+BasicTuple<T> normalize(const BasicTuple<T>& t) {
+    return simd::normalize(t);
+}
+
+template <typename T>
+T dot(const BasicTuple<T>& a, const BasicTuple<T>& b) {
+    return simd::dot(a, b);
 }
 
-float dot(const Tuple& a, const Tuple& b) {
-    return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+template <typename T>
+BasicTuple<T> cross(const BasicTuple<T>& a, const BasicTuple<T>& b) {
+    return simd::cross(a, b);
 }
 
-Tuple cross(const Tuple& a, const Tuple& b) {
-    return vector(  a.y * b.z - a.z * b.y,
-                    a.z * b.x - a.x * b.z,
-                    a.x * b.y - a.y * b.x );
+template <typename T>
+BasicTuple<T> hadamard_product(const BasicTuple<T>& c1, const BasicTuple<T>& c2) {
+    return simd::hadamard(c1, c2);
 }
 
-Tuple hadamard_product(const Tuple& c1, const Tuple& c2) {
-    return color(c1.x * c2.x, c1.y * c2.y, c1.z * c2.z);
-}
\ No newline at end of file
+template <typename T>
+BasicTuple<T> reflect(const BasicTuple<T>& in, const BasicTuple<T>& normal) {
+    return in - normal * (2 * dot(in, normal));
+}
+
+#define INSTANTIATE_TUPLE(T)                                                    \
+    template struct BasicTuple<T>;                                              \
+    template bool operator== (const BasicTuple<T>&, const BasicTuple<T>&);      \
+    template bool operator!= (const BasicTuple<T>&, const BasicTuple<T>&);      \
+    template BasicTuple<T> operator+ (const BasicTuple<T>&, const BasicTuple<T>&); \
+    template BasicTuple<T> operator- (const BasicTuple<T>&, const BasicTuple<T>&); \
+    template BasicTuple<T> operator* (const BasicTuple<T>&, const Scalar<T>);   \
+    template BasicTuple<T> operator* (const Scalar<T>, const BasicTuple<T>&);   \
+    template BasicTuple<T> operator/ (const BasicTuple<T>&, const Scalar<T>);   \
+    template BasicTuple<T> point<T>(Scalar<T>, Scalar<T>, Scalar<T>);           \
+    template BasicTuple<T> vector<T>(Scalar<T>, Scalar<T>, Scalar<T>);          \
+    template BasicTuple<T> color<T>(Scalar<T>, Scalar<T>, Scalar<T>);           \
+    template T dot(const BasicTuple<T>&, const BasicTuple<T>&);                 \
+    template BasicTuple<T> cross(const BasicTuple<T>&, const BasicTuple<T>&);   \
+    template BasicTuple<T> normalize(const BasicTuple<T>&);                     \
+    template BasicTuple<T> hadamard_product(const BasicTuple<T>&, const BasicTuple<T>&); \
+    template BasicTuple<T> reflect(const BasicTuple<T>&, const BasicTuple<T>&);
+
+INSTANTIATE_TUPLE(float)
+INSTANTIATE_TUPLE(double)
@@ -1,52 +1,85 @@
 #ifndef TUPLES_H
 #define TUPLES_H
 
+#include <type_traits>
 #include "tools.h"
 
-struct Tuple {
-    float x;
-    float y;
-    float z;
-    float w;
+// Tuple over float or double. Aligned to its own size so a float Tuple
+// loads into one SSE register and a double one into one AVX register.
+// Everything is instantiated for float and double in tuples.cpp.
+template <typename T>
+struct alignas(4 * sizeof(T)) BasicTuple {
+    T x;
+    T y;
+    T z;
+    T w;
 
     bool isPoint();
 
     bool isVector();
 
-    Tuple operator-() const;
+    BasicTuple operator-() const;
     
-    float magnitude() const;
+    T magnitude() const;
 };
 
-bool operator== (const Tuple& t1, const Tuple& t2);
+// single precision, what the renderer uses by default
+using Tuple = BasicTuple<float>;
 
-bool operator!= (const Tuple& t1, const Tuple& t2);
+using TupleD = BasicTuple<double>;
+
+// Scalars are not deduced from the arguments, so point(1, 2, 3) is a
+// float Tuple and point<double>(1, 2, 3) a double one.
+template <typename T>
+using Scalar = std::type_identity_t<T>;
+
+template <typename T>
+bool operator== (const BasicTuple<T>& t1, const BasicTuple<T>& t2);
+
+template <typename T>
+bool operator!= (const BasicTuple<T>& t1, const BasicTuple<T>& t2);
 
 // is it the user's responsibility to guarantee not to add two points?
-Tuple operator+ (const Tuple& t1, const Tuple& t2);
+template <typename T>
+BasicTuple<T> operator+ (const BasicTuple<T>& t1, const BasicTuple<T>& t2);
 
 // Should not subtract point from vector
-Tuple operator- (const Tuple& t1, const Tuple& t2);
+template <typename T>
+BasicTuple<T> operator- (const BasicTuple<T>& t1, const BasicTuple<T>& t2);
 
-Tuple operator* (const Tuple& t, const float s);
+template <typename T>
+BasicTuple<T> operator* (const BasicTuple<T>& t, const Scalar<T> s);
 
-Tuple operator* (const float s, const Tuple& t);
+template <typename T>
+BasicTuple<T> operator* (const Scalar<T> s, const BasicTuple<T>& t);
 
 // check for s == 0
-Tuple operator/ (const Tuple& t, const float s);
+template <typename T>
+BasicTuple<T> operator/ (const BasicTuple<T>& t, const Scalar<T> s);
+
+template <typename T = float>
+BasicTuple<T> point(Scalar<T> x, Scalar<T> y, Scalar<T> z);
 
-Tuple point(float x, float y, float z);
+template <typename T = float>
+BasicTuple<T> vector(Scalar<T> x, Scalar<T> y, Scalar<T> z);
 
-Tuple vector(float x, float y, float z);
+template <typename T = float>
+BasicTuple<T> color(Scalar<T> x, Scalar<T> y, Scalar<T> z);
 
-Tuple color(float x, float y, float z);
+template <typename T>
+T dot(const BasicTuple<T>& a, const BasicTuple<T>& b);
 
-float dot(const Tuple& a, const Tuple& b);
+template <typename T>
+BasicTuple<T> cross(const BasicTuple<T>& a, const BasicTuple<T>& b);
 
-Tuple cross(const Tuple& a, const Tuple& b);
+template <typename T>
+BasicTuple<T> normalize(const BasicTuple<T>& t);
 
-Tuple normalize(const Tuple& t);
+template <typename T>
+BasicTuple<T> hadamard_product(const BasicTuple<T>& c1, const BasicTuple<T>& c2);
 
-Tuple hadamard_product(const Tuple& c1, const Tuple& c2);
+// in reflected around normal, which must be normalized
+template <typename T>
+BasicTuple<T> reflect(const BasicTuple<T>& in, const BasicTuple<T>& normal);
 
-#endif
\ No newline at end of file
+#endif
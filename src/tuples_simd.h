@@ -0,0 +1,175 @@
+#ifndef TUPLES_SIMD_H
+#define TUPLES_SIMD_H
+
+// Tuple arithmetic kernels. simd::scalar is the portable reference,
+// simd::sse works on one 128-bit register per float Tuple. The unqualified
+// simd:: functions pick the best one available at compile time; double
+// tuples always use the scalar ones.
+// Define RAY_TRACER_NO_SIMD to force the scalar versions.
+
+#include <cmath>
+#include "tuples.h"
+
+#if !defined(RAY_TRACER_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#define RAY_TRACER_SSE 1
+#include <immintrin.h>
+#endif
+
+namespace simd {
+
+// templates, so they also serve double tuples
+namespace scalar {
+    template <typename T>
+    inline BasicTuple<T> add(const BasicTuple<T>& a, const BasicTuple<T>& b) {
+        return {a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w};
+    }
+
+    template <typename T>
+    inline BasicTuple<T> sub(const BasicTuple<T>& a, const BasicTuple<T>& b) {
+        return {a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w};
+    }
+
+    template <typename T>
+    inline BasicTuple<T> neg(const BasicTuple<T>& a) {
+        return {-a.x, -a.y, -a.z, -a.w};
+    }
+
+    template <typename T>
+    inline BasicTuple<T> mul(const BasicTuple<T>& a, Scalar<T> s) {
+        return {a.x * s, a.y * s, a.z * s, a.w * s};
+    }
+
+    template <typename T>
+    inline BasicTuple<T> div(const BasicTuple<T>& a, Scalar<T> s) {
+        return {a.x / s, a.y / s, a.z / s, a.w / s};
+    }
+
+    template <typename T>
+    inline T dot(const BasicTuple<T>& a, const BasicTuple<T>& b) {
+        return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+    }
+
+    template <typename T>
+    inline BasicTuple<T> cross(const BasicTuple<T>& a, const BasicTuple<T>& b) {
+        return {a.y * b.z - a.z * b.y,
+                a.z * b.x - a.x * b.z,
+                a.x * b.y - a.y * b.x, 0};
+    }
+
+    template <typename T>
+    inline BasicTuple<T> normalize(const BasicTuple<T>& a) {
+        return scalar::div(a, std::sqrt(scalar::dot(a, a)));
+    }
+
+    template <typename T>
+    inline BasicTuple<T> hadamard(const BasicTuple<T>& a, const BasicTuple<T>& b) {
+        return {a.x * b.x, a.y * b.y, a.z * b.z, 0};
+    }
+
+    // rows points at four rows of four values
+    template <typename T>
+    inline BasicTuple<T> mat_mul(const T* const rows[4], const BasicTuple<T>& t) {
+        return {rows[0][0] * t.x + rows[0][1] * t.y + rows[0][2] * t.z + rows[0][3] * t.w,
+                rows[1][0] * t.x + rows[1][1] * t.y + rows[1][2] * t.z + rows[1][3] * t.w,
+                rows[2][0] * t.x + rows[2][1] * t.y + rows[2][2] * t.z + rows[2][3] * t.w,
+                rows[3][0] * t.x + rows[3][1] * t.y + rows[3][2] * t.z + rows[3][3] * t.w};
+    }
+}
+
+#ifdef RAY_TRACER_SSE
+namespace sse {
+    inline __m128 load(const Tuple& t) { return _mm_load_ps(&t.x); }
+
+    inline Tuple store(__m128 v) {
+        Tuple t;
+        _mm_store_ps(&t.x, v);
+        return t;
+    }
+
+    // sum of all four lanes, broadcast to every lane
+    inline __m128 hsum(__m128 v) {
+        __m128 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+        __m128 sums = _mm_add_ps(v, shuf);
+        shuf = _mm_shuffle_ps(sums, sums, _MM_SHUFFLE(1, 0, 3, 2));
+        return _mm_add_ps(sums, shuf);
+    }
+
+    // clears the w lane
+    inline __m128 xyz(__m128 v) {
+        const __m128 mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+        return _mm_and_ps(v, mask);
+    }
+
+    inline Tuple add(const Tuple& a, const Tuple& b) {
+        return store(_mm_add_ps(load(a), load(b)));
+    }
+
+    inline Tuple sub(const Tuple& a, const Tuple& b) {
+        return store(_mm_sub_ps(load(a), load(b)));
+    }
+
+    inline Tuple neg(const Tuple& a) {
+        return store(_mm_xor_ps(load(a), _mm_set1_ps(-0.0f)));
+    }
+
+    inline Tuple mul(const Tuple& a, float s) {
+        return store(_mm_mul_ps(load(a), _mm_set1_ps(s)));
+    }
+
+    inline Tuple div(const Tuple& a, float s) {
+        return store(_mm_div_ps(load(a), _mm_set1_ps(s)));
+    }
+
+    inline float dot(const Tuple& a, const Tuple& b) {
+        return _mm_cvtss_f32(hsum(_mm_mul_ps(load(a), load(b))));
+    }
+
+    inline Tuple cross(const Tuple& a, const Tuple& b) {
+        __m128 va = load(a);
+        __m128 vb = load(b);
+        __m128 a_yzx = _mm_shuffle_ps(va, va, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 b_yzx = _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(3, 0, 2, 1));
+        // a * b.yzx - a.yzx * b gives the cross product in zxy order
+        __m128 c = _mm_sub_ps(_mm_mul_ps(va, b_yzx), _mm_mul_ps(a_yzx, vb));
+        return store(xyz(_mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1))));
+    }
+
+    inline Tuple normalize(const Tuple& a) {
+        __m128 v = load(a);
+        __m128 len = _mm_sqrt_ps(hsum(_mm_mul_ps(v, v)));
+        return store(_mm_div_ps(v, len));
+    }
+
+    inline Tuple hadamard(const Tuple& a, const Tuple& b) {
+        return store(xyz(_mm_mul_ps(load(a), load(b))));
+    }
+
+    inline Tuple mat_mul(const float* const rows[4], const Tuple& t) {
+        // transposing the rows gives the columns; when the matrix is the
+        // same for many tuples the compiler hoists this out of the loop
+        __m128 c0 = _mm_loadu_ps(rows[0]);
+        __m128 c1 = _mm_loadu_ps(rows[1]);
+        __m128 c2 = _mm_loadu_ps(rows[2]);
+        __m128 c3 = _mm_loadu_ps(rows[3]);
+        _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+        __m128 v = load(t);
+        __m128 x = _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0));
+        __m128 y = _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1));
+        __m128 z = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2));
+        __m128 w = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3));
+        return store(_mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, x), _mm_mul_ps(c1, y)),
+                                _mm_add_ps(_mm_mul_ps(c2, z), _mm_mul_ps(c3, w))));
+    }
+}
+
+// the float overloads in sse are preferred over the scalar templates
+using namespace scalar;
+using namespace sse;
+#else
+using namespace scalar;
+#endif
+
+}
+
+#endif
@@ -1,10 +1,41 @@
 #include <catch2/catch_test_macros.hpp>
 #include "../src/tools.h"
 #include "../src/tuples.h"
+#include "../src/tuples_simd.h"
 #include "../src/canvas.h"
 #include "../src/matrices.h"
 #include "../src/transformations.h"
+#include "../src/thread_pool.h"
+#include "../src/render.h"
+#include "../src/rays.h"
+#include "../src/intersections.h"
+#include "../src/spheres.h"
+#include "../src/bounds.h"
+#include "../src/bvh.h"
+#include "../src/cached_transform.h"
+#include "../src/affine.h"
+#include "../src/tuple_batch.h"
+#include "../src/mapped_canvas.h"
+#include "../src/qoi.h"
+#include "../src/png.h"
+#include "../src/pipeline.h"
+#include "../src/tiled_canvas.h"
+#include "../src/trace.h"
+#include "../src/scene.h"
+#include "../src/camera.h"
+#include "../src/lighting.h"
+#include "../src/arena.h"
 #include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <array>
+#include <stdexcept>
+#include <filesystem>
+#include <system_error>
 
 TEST_CASE("Matrix transformations", "[transformations]") {
     SECTION("Translation") {
@@ -120,6 +151,80 @@ TEST_CASE("Matrix transformations", "[transformations]") {
     }
 }
 
+TEST_CASE("Compile-time transformations", "[transformations]") {
+    SECTION("Builders can be evaluated by the compiler") {
+        constexpr Mat4 t = translation(5, -3, 2);
+        static_assert(t[0][3] == 5 && t[1][3] == -3 && t[2][3] == 2);
+
+        constexpr Mat4 r = rotation_z(M_PI / 2);
+        static_assert(r[0][1] < -0.99999f && r[0][1] > -1.00001f);
+        static_assert(r[0][0] < 0.00001f && r[0][0] > -0.00001f);
+
+        constexpr Mat4 m = translation(1, 2, 3) * scaling(2, 2, 2);
+        static_assert(m[0][0] == 2 && m[0][3] == 1);
+        REQUIRE(m * point(1, 1, 1) == point(3, 4, 5));
+    }
+
+    SECTION("Compile-time sine and cosine match the run-time ones") {
+        constexpr float angles[] = {-7.5, -3.1, -1, -0.2, 0, 0.3, 1, 
+            M_PI / 4, M_PI / 2, 2.5, M_PI, 4, 10, 100};
+        constexpr int n = sizeof(angles) / sizeof(angles[0]);
+        constexpr auto sines = [&] {
+            std::array<float, n> res {};
+            for (int i = 0; i < n; i++) {
+                res[i] = transformations_detail::sin(angles[i]);
+            }
+            return res;
+        }();
+        constexpr auto cosines = [&] {
+            std::array<float, n> res {};
+            for (int i = 0; i < n; i++) {
+                res[i] = transformations_detail::cos(angles[i]);
+            }
+            return res;
+        }();
+        for (int i = 0; i < n; i++) {
+            CHECK(std::abs(sines[i] - std::sin(angles[i])) < 0.000001);
+            CHECK(std::abs(cosines[i] - std::cos(angles[i])) < 0.000001);
+        }
+    }
+
+    SECTION("A chain applies transformations in the order written") {
+        constexpr Mat4 chained = TransformChain()
+            .rotate_x(M_PI / 2)
+            .scale(5, 5, 5)
+            .translate(10, 5, 7);
+        REQUIRE(chained * point(1, 0, 1) == point(15, 0, 7));
+
+        // same as multiplying the builders in reverse order
+        Mat4 expected = translation(10, 5, 7) * scaling(5, 5, 5) * rotation_x(M_PI / 2);
+        REQUIRE(chained == expected);
+    }
+
+    SECTION("Every chain step matches the corresponding builder") {
+        float a = 0.7f;
+        Mat4 start = shearing(1, 0.5, 0, 2, 0, 0) * translation(1, 2, 3);
+        TransformChain c(start);
+
+        REQUIRE(c.translate(a, 2, 3).matrix() == translation(a, 2, 3) * start);
+        REQUIRE(c.scale(a, 2, 3).matrix() == scaling(a, 2, 3) * start);
+        REQUIRE(c.rotate_x(a).matrix() == rotation_x(a) * start);
+        REQUIRE(c.rotate_y(a).matrix() == rotation_y(a) * start);
+        REQUIRE(c.rotate_z(a).matrix() == rotation_z(a) * start);
+        REQUIRE(c.shear(1, 2, 3, 4, 5, 6).matrix() == shearing(1, 2, 3, 4, 5, 6) * start);
+        REQUIRE(c.then(rotation_y(a)).matrix() == rotation_y(a) * start);
+
+        // compare precisely, not only within equal()
+        Mat4 chained = c.rotate_y(a).translate(4, 5, 6).scale(2, 3, 4);
+        Mat4 multiplied = scaling(2, 3, 4) * translation(4, 5, 6) * rotation_y(a) * start;
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                CHECK(std::abs(chained[i][j] - multiplied[i][j]) < 0.0001);
+            }
+        }
+    }
+}
+
 TEST_CASE("Matrices operations", "[matrices]") {
     SECTION("Constructing and inspecting matrices") {
         Matrix m = {{1,2,3,4},
@@ -221,6 +326,59 @@ TEST_CASE("Matrices operations", "[matrices]") {
     }
 }
 
+TEST_CASE("Fixed-size 4x4 matrices", "[matrices]") {
+    Matrix a = { { 1 , 2 , 3 , 4 },
+                 { 5 , 6 , 7 , 8 },
+                 { 9 , 8 , 7 , 6 },
+                 { 5 , 4 , 3 , 2 } };
+    Matrix b = { { -2 , 1 , 2 , 3 },
+                 { 3 , 2 , 1 , -1 },
+                 { 4 , 3 , 6 , 5 },
+                 { 1 , 2 , 7 , 8 }};
+
+    SECTION("Converting between Matrix and Mat4") {
+        Mat4 m = to_mat4(a);
+        REQUIRE(m[0][0] == 1);
+        REQUIRE(m[1][2] == 7);
+        REQUIRE(m[3][3] == 2);
+
+        Matrix back = m;
+        REQUIRE(back.size() == 4);
+        REQUIRE(back[2][1] == 8);
+        REQUIRE(back == a);
+    }
+
+    SECTION("Mat4 operations match Matrix operations") {
+        Mat4 ma = to_mat4(a);
+        Mat4 mb = to_mat4(b);
+        REQUIRE(ma * mb == to_mat4(a * b));
+        REQUIRE(transpose(ma) == to_mat4(transpose(a)));
+        REQUIRE(ma * matrices::identity4 == ma);
+
+        Tuple t {1, 2, 3, 1};
+        REQUIRE(ma * t == a * t);
+    }
+
+    SECTION("Determinant and inverse of a Mat4") {
+        Matrix A =  {{ -5 , 2 , 6 , -8 },
+                     { 1 , -5 , 1 , 8 },
+                     { 7 , 7 , -6 , -7 },
+                     { 1 , -3 , 7 , 4 } };
+        Mat4 m = to_mat4(A);
+        REQUIRE(determinant(m) == 532);
+        REQUIRE(isInvertible(m));
+        REQUIRE(inverse(m) == to_mat4(inverse(A)));
+        REQUIRE(m * inverse(m) == matrices::identity4);
+
+        Mat4 singular = to_mat4({{ -4 , 2 , -2 , -3 },
+                                 { 9 , 6 ,2 , 6 },
+                                 { 0 , -5 , 1 , -5 },
+                                 { 0 , 0 , 0 , 0 } });
+        REQUIRE(determinant(singular) == 0);
+        REQUIRE(!isInvertible(singular));
+    }
+}
+
 TEST_CASE("Inverting matrices", "[matrices]") {
     SECTION("Calculating the determinant of a 2x2 matrix") {
         Matrix A = {{1, 5}, {-3, 2}};
@@ -313,9 +471,9 @@ TEST_CASE("Inverting matrices", "[matrices]") {
                       { -0.52256 , -0.81391 , -0.30075 , 0.30639 } };
         CHECK( determinant(A) == 532 );
         CHECK( cofactor(A, 2, 3) == -160 );
-        CHECK( equal(B[3][2], -160/532 ) );
+        CHECK( equal(B[3][2], -160.0/532 ) );
         CHECK( cofactor(A, 3, 2) == 105 );
-        CHECK( equal(B[2][3], 105/532 ) );
+        CHECK( equal(B[2][3], 105.0/532 ) );
         REQUIRE( res == B );
 
         Matrix C =  {{ 8 , -5 , 9 , 2 },
@@ -360,6 +518,76 @@ TEST_CASE("Inverting matrices", "[matrices]") {
     }
 }
 
+TEST_CASE("Closed-form, LU and checked inverses", "[matrices]") {
+    SECTION("The closed-form 4x4 inverse matches the cofactor definition") {
+        Mat4 m = to_mat4({{ 8 , -5 , 9 , 2 },
+                          { 7 , 5 , 6 , 1 },
+                          { -6 , 0 , 9 , 6 },
+                          { -3 , 0 , -9 , -4 } });
+        REQUIRE(determinant(m) == -585);
+        Mat4 inv = inverse(m);
+        for (int r = 0; r < 4; r++) {
+            for (int c = 0; c < 4; c++) {
+                CHECK(std::abs(inv[c][r] - cofactor(Matrix(m), r, c) / -585) < 0.00001);
+            }
+        }
+    }
+
+    SECTION("Inverting a 3x3 matrix through LU decomposition") {
+        Matrix A = {{ 0 , 2 , 1 },
+                    { 1 , 1 , 0 },
+                    { 3 , 0 , 1 } };
+        REQUIRE(determinant(A) == -5);
+
+        Matrix inv = inverse(A);
+        Matrix expected = {{ -0.2 , 0.4 , 0.2 },
+                           { 0.2 , 0.6 , -0.2 },
+                           { 0.6 , -1.2 , 0.4 } };
+        for (int r = 0; r < 3; r++) {
+            for (int c = 0; c < 3; c++) {
+                CHECK(std::abs(inv[r][c] - expected[r][c]) < 0.00001);
+            }
+        }
+    }
+
+    SECTION("Inverting a 5x5 matrix through LU decomposition") {
+        Matrix A = {{ 2 , 0 , 1 , 0 , 3 },
+                    { 0 , 1 , 0 , 4 , 0 },
+                    { 1 , 0 , 5 , 0 , 1 },
+                    { 0 , 2 , 0 , 1 , 0 },
+                    { 3 , 0 , 1 , 0 , 7 } };
+        Matrix inv = inverse(A);
+        for (int r = 0; r < 5; r++) {
+            for (int c = 0; c < 5; c++) {
+                float sum = 0;
+                for (int k = 0; k < 5; k++) {
+                    sum += A[r][k] * inv[k][c];
+                }
+                CHECK(std::abs(sum - (r == c ? 1 : 0)) < 0.00001);
+            }
+        }
+    }
+
+    SECTION("Checked inverses report singular matrices") {
+        Matrix B =  {{ -4 , 2 , -2 , -3 },
+                     { 9 , 6 ,2 , 6 },
+                     { 0 , -5 , 1 , -5 },
+                     { 0 , 0 , 0 , 0 } };
+        REQUIRE(!checked_inverse(B));
+        REQUIRE(!checked_inverse(to_mat4(B)));
+
+        Matrix C = {{ 1 , 2 , 3 },
+                    { 2 , 4 , 6 },
+                    { 0 , 1 , 1 } };
+        REQUIRE(!checked_inverse(C));
+        REQUIRE(determinant(C) == 0);
+
+        std::optional<Mat4> inv = checked_inverse(translation(1, 2, 3));
+        REQUIRE(inv);
+        REQUIRE(*inv == translation(-1, -2, -3));
+    }
+}
+
 TEST_CASE("Canvas creation", "[canvas]") {
     Canvas c = Canvas(10, 20);
     REQUIRE(c.width == 10);
@@ -377,6 +605,24 @@ TEST_CASE("Canvas creation", "[canvas]") {
         c.write_pixel(2, 3, red);
         REQUIRE(c.pixel_at(2, 3) == red);
     }
+
+    SECTION("Canvas pixels are stored row by row") {
+        Tuple red = color(1, 0, 0);
+        c.write_pixel(2, 3, red);
+        REQUIRE(c.data().size() == 200);
+        REQUIRE(c.row(3).size() == 10);
+        REQUIRE(c.row(3)[2] == red);
+        REQUIRE(&c.row(3)[2] == &c.data()[3 * 10 + 2]);
+
+        // rows can be written in place
+        Tuple blue = color(0, 0, 1);
+        for (Tuple& p : c.row(19)) {
+            p = blue;
+        }
+        REQUIRE(c.pixel_at(0, 19) == blue);
+        REQUIRE(c.pixel_at(9, 19) == blue);
+        REQUIRE(c.pixel_at(9, 18) == black);
+    }
 }
 
 TEST_CASE("Constructing PPM data", "[canvas]") {
@@ -421,6 +667,60 @@ TEST_CASE("Constructing PPM data", "[canvas]") {
         std::string ppm = canvas.to_ppm();
         REQUIRE(ppm.find("\n", ppm.length()-1));
     }
+
+    SECTION("Writing binary PPM data to a stream") {
+        c.write_pixel(0, 0, color(1.5, 0, 0));
+        c.write_pixel(2, 1, color(0, 0.5, 0));
+        std::ostringstream out;
+        c.write_ppm(out, PpmFormat::P6);
+        std::string ppm = out.str();
+
+        std::string header = "P6\n5 3\n255\n";
+        REQUIRE(ppm.rfind(header, 0) == 0);
+        REQUIRE(ppm.size() == header.size() + 5 * 3 * 3);
+        REQUIRE(static_cast<unsigned char>(ppm[header.size()]) == 255);
+        REQUIRE(static_cast<unsigned char>(ppm[header.size() + (1 * 5 + 2) * 3 + 1]) == 128);
+    }
+
+    SECTION("Writing PPM data to a file descriptor") {
+        FILE* f = std::tmpfile();
+        REQUIRE(f != nullptr);
+        c.write_ppm(fileno(f), PpmFormat::P3);
+        std::rewind(f);
+        std::string ppm;
+        char buf[256];
+        size_t n;
+        while ((n = std::fread(buf, 1, sizeof buf, f)) > 0) {
+            ppm.append(buf, n);
+        }
+        std::fclose(f);
+        REQUIRE(ppm == c.to_ppm());
+    }
+
+    SECTION("Large images stream through the fixed-size buffer") {
+        Canvas canvas = Canvas(300, 200, color(1, 0.8, 0.6));
+        std::ostringstream out;
+        canvas.write_ppm(out, PpmFormat::P3);
+        std::string ppm = out.str();
+        REQUIRE(ppm == canvas.to_ppm());
+
+        std::istringstream lines(ppm);
+        std::string line;
+        int values = 0, long_lines = 0;
+        for (int i = 0; std::getline(lines, line); i++) {
+            if (line.size() > 70) long_lines++;
+            if (i < 3) continue;
+            std::istringstream tokens(line);
+            int v;
+            while (tokens >> v) values++;
+        }
+        REQUIRE(long_lines == 0);
+        REQUIRE(values == 300 * 200 * 3);
+
+        std::ostringstream bin;
+        canvas.write_ppm(bin, PpmFormat::P6);
+        REQUIRE(bin.str().size() == std::string("P6\n300 200\n255\n").size() + 300 * 200 * 3);
+    }
     
 }
 
@@ -592,4 +892,1712 @@ TEST_CASE ("Distinguish between points and vectors", "[tuple]") {
         Tuple expected4 = color(0.9, 0.2, 0.04);
         REQUIRE(hadamard_product(c4, c5) == expected4);
     }
-}
\ No newline at end of file
+}
+
+TEST_CASE("SIMD tuple kernels match the scalar versions", "[tuple]") {
+    auto same = [](const Tuple& a, const Tuple& b) {
+        return std::abs(a.x - b.x) < 0.00001 && std::abs(a.y - b.y) < 0.00001
+            && std::abs(a.z - b.z) < 0.00001 && std::abs(a.w - b.w) < 0.00001;
+    };
+
+    Tuple values[] = { {1, -2, 3, -4}, {4.3, -4.2, 3.1, 1}, {0.25, 0.5, 0.75, 0},
+                       {-1.5, 2.5, -0.125, 1}, {0.9, 0.6, 0.75, 0} };
+    Mat4 m = rotation_z(0.3) * scaling(2, 0.5, 3) * translation(1, -2, 0.5);
+    const float* rows[4] = {m[0], m[1], m[2], m[3]};
+
+    for (const Tuple& a : values) {
+        for (const Tuple& b : values) {
+            CHECK(same(simd::add(a, b), simd::scalar::add(a, b)));
+            CHECK(same(simd::sub(a, b), simd::scalar::sub(a, b)));
+            CHECK(same(simd::cross(a, b), simd::scalar::cross(a, b)));
+            CHECK(same(simd::hadamard(a, b), simd::scalar::hadamard(a, b)));
+            CHECK(std::abs(simd::dot(a, b) - simd::scalar::dot(a, b)) < 0.00001);
+        }
+        CHECK(same(simd::neg(a), simd::scalar::neg(a)));
+        CHECK(same(simd::mul(a, 3.5), simd::scalar::mul(a, 3.5)));
+        CHECK(same(simd::div(a, 2), simd::scalar::div(a, 2)));
+        CHECK(same(simd::normalize(a), simd::scalar::normalize(a)));
+        CHECK(same(simd::mat_mul(rows, a), simd::scalar::mat_mul(rows, a)));
+        CHECK(same(m * a, Matrix(m) * a));
+    }
+}
+
+TEST_CASE("Tile-based rendering", "[render]") {
+    // cost varies a lot between pixels so threads steal from each other
+    auto shade = [](int x, int y) {
+        float v = 0;
+        int steps = (x * 7 + y * 13) % 97 * (x % 5 == 0 ? 50 : 1);
+        for (int i = 0; i < steps; i++) {
+            v += std::sin(x * 0.01f + i) * std::cos(y * 0.02f - i);
+        }
+        return color(x / 63.0f, y / 47.0f, v);
+    };
+
+    SECTION("Every pixel is covered by exactly one tile") {
+        ThreadPool pool(4);
+        std::vector<std::atomic<int>> hits(37 * 23);
+        for_each_tile(37, 23, [&](const Tile& t) {
+            for (int y = t.y0; y < t.y1; y++) {
+                for (int x = t.x0; x < t.x1; x++) {
+                    hits[y * 37 + x]++;
+                }
+            }
+        }, {8, &pool});
+
+        int wrong = 0;
+        for (auto& h : hits) {
+            if (h != 1) wrong++;
+        }
+        REQUIRE(wrong == 0);
+    }
+
+    SECTION("The image does not depend on the number of threads") {
+        Canvas reference(64, 48);
+        ThreadPool single(1);
+        render(reference, shade, {16, &single});
+        REQUIRE(reference.pixel_at(63, 47) == color(1, 1, reference.pixel_at(63, 47).z));
+
+        for (int threads : {2, 3, 8}) {
+            for (int tile : {1, 7, 16, 100}) {
+                ThreadPool pool(threads);
+                Canvas c(64, 48);
+                render(c, shade, {tile, &pool});
+                REQUIRE(std::memcmp(c.data().data(), reference.data().data(), 
+                    c.data().size_bytes()) == 0);
+            }
+        }
+    }
+
+    SECTION("Exceptions thrown while shading reach the caller") {
+        ThreadPool pool(3);
+        Canvas c(32, 32);
+        auto failing = [](int x, int y) {
+            if (x == 20 && y == 5) throw std::runtime_error("bad pixel");
+            return color(0, 0, 0);
+        };
+        REQUIRE_THROWS_AS(render(c, failing, {8, &pool}), std::runtime_error);
+
+        // the pool is still usable afterwards
+        render(c, [](int, int) { return color(1, 1, 1); }, {8, &pool});
+        REQUIRE(c.pixel_at(31, 31) == color(1, 1, 1));
+    }
+
+    SECTION("Nested parallel_for() on the same pool runs inline") {
+        ThreadPool pool(3);
+        std::vector<std::atomic<int>> hits(16 * 16);
+        pool.parallel_for(16, [&](int i) {
+            pool.parallel_for(16, [&](int j) { hits[i * 16 + j]++; });
+        });
+
+        int wrong = 0;
+        for (auto& h : hits) {
+            if (h != 1) wrong++;
+        }
+        REQUIRE(wrong == 0);
+    }
+}
+
+TEST_CASE("Rays", "[rays]") {
+    SECTION("Computing a point from a distance") {
+        Ray r {point(2, 3, 4), vector(1, 0, 0)};
+        REQUIRE(position(r, 0) == point(2, 3, 4));
+        REQUIRE(position(r, 1) == point(3, 3, 4));
+        REQUIRE(position(r, -1) == point(1, 3, 4));
+        REQUIRE(position(r, 2.5) == point(4.5, 3, 4));
+    }
+
+    SECTION("Translating a ray") {
+        Ray r {point(1, 2, 3), vector(0, 1, 0)};
+        Ray r2 = transform(r, translation(3, 4, 5));
+        REQUIRE(r2.origin == point(4, 6, 8));
+        REQUIRE(r2.direction == vector(0, 1, 0));
+    }
+
+    SECTION("Scaling a ray") {
+        Ray r {point(1, 2, 3), vector(0, 1, 0)};
+        Matrix m = scaling(2, 3, 4);
+        Ray r2 = transform(r, m);
+        REQUIRE(r2.origin == point(2, 6, 12));
+        REQUIRE(r2.direction == vector(0, 3, 0));
+    }
+
+    SECTION("Ray packets store rays component by component") {
+        RayPacket packet;
+        packet.push_back({point(1, 2, 3), vector(4, 5, 6)});
+        packet.push_back({point(-1, -2, -3), vector(0, 0, 1)});
+        REQUIRE(packet.size() == 2);
+        REQUIRE(packet.oy[1] == -2);
+        REQUIRE(packet.dz[0] == 6);
+        REQUIRE(packet.at(0).origin == point(1, 2, 3));
+        REQUIRE(packet.at(1).direction == vector(0, 0, 1));
+        packet.clear();
+        REQUIRE(packet.size() == 0);
+    }
+}
+
+TEST_CASE("Ray-sphere intersections", "[spheres]") {
+    Sphere s;
+    Intersections xs;
+
+    SECTION("A ray intersects a sphere at two points") {
+        intersect(s, {point(0, 0, -5), vector(0, 0, 1)}, xs);
+        REQUIRE(xs.size() == 2);
+        REQUIRE(xs[0].t == 4.0);
+        REQUIRE(xs[1].t == 6.0);
+        REQUIRE(xs[0].object == &s);
+    }
+
+    SECTION("A ray intersects a sphere at a tangent") {
+        intersect(s, {point(0, 1, -5), vector(0, 0, 1)}, xs);
+        REQUIRE(xs.size() == 2);
+        REQUIRE(xs[0].t == 5.0);
+        REQUIRE(xs[1].t == 5.0);
+    }
+
+    SECTION("A ray misses a sphere") {
+        intersect(s, {point(0, 2, -5), vector(0, 0, 1)}, xs);
+        REQUIRE(xs.empty());
+    }
+
+    SECTION("A ray originates inside a sphere") {
+        intersect(s, {point(0, 0, 0), vector(0, 0, 1)}, xs);
+        REQUIRE(xs.size() == 2);
+        REQUIRE(xs[0].t == -1.0);
+        REQUIRE(xs[1].t == 1.0);
+    }
+
+    SECTION("A sphere is behind a ray") {
+        intersect(s, {point(0, 0, 5), vector(0, 0, 1)}, xs);
+        REQUIRE(xs.size() == 2);
+        REQUIRE(xs[0].t == -6.0);
+        REQUIRE(xs[1].t == -4.0);
+    }
+
+    SECTION("Intersecting scaled and translated spheres") {
+        Ray r {point(0, 0, -5), vector(0, 0, 1)};
+        s.transform = scaling(2, 2, 2);
+        intersect(s, r, xs);
+        REQUIRE(xs.size() == 2);
+        REQUIRE(xs[0].t == 3);
+        REQUIRE(xs[1].t == 7);
+
+        xs.clear();
+        s.transform = translation(5, 0, 0);
+        intersect(s, r, xs);
+        REQUIRE(xs.empty());
+    }
+
+    SECTION("Intersection lists reuse their storage") {
+        Ray r {point(0, 0, -5), vector(0, 0, 1)};
+        intersect(s, r, xs);
+        const Intersection* storage = xs.data();
+        for (int i = 0; i < 10; i++) {
+            xs.clear();
+            intersect(s, r, xs);
+        }
+        REQUIRE(xs.data() == storage);
+    }
+
+    SECTION("Intersecting a list of spheres sorts the intersections") {
+        Sphere spheres[2];
+        spheres[1].transform = scaling(0.5, 0.5, 0.5);
+        intersect(spheres, {point(0, 0, -5), vector(0, 0, 1)}, xs);
+        REQUIRE(xs.size() == 4);
+        REQUIRE(xs[0].t == 4);
+        REQUIRE(xs[1].t == 4.5);
+        REQUIRE(xs[2].t == 5.5);
+        REQUIRE(xs[3].t == 6);
+        REQUIRE(xs[1].object == &spheres[1]);
+    }
+}
+
+TEST_CASE("Identifying hits", "[intersections]") {
+    Sphere s;
+
+    SECTION("The hit, when all intersections have positive t") {
+        Intersections xs {{1, &s}, {2, &s}};
+        REQUIRE(hit(xs) == &xs[0]);
+    }
+
+    SECTION("The hit, when some intersections have negative t") {
+        Intersections xs {{-1, &s}, {1, &s}};
+        REQUIRE(hit(xs) == &xs[1]);
+    }
+
+    SECTION("The hit, when all intersections have negative t") {
+        Intersections xs {{-2, &s}, {-1, &s}};
+        REQUIRE(hit(xs) == nullptr);
+    }
+
+    SECTION("The hit is always the lowest nonnegative intersection") {
+        Intersections xs {{5, &s}, {7, &s}, {-3, &s}, {2, &s}};
+        REQUIRE(hit(xs) == &xs[3]);
+    }
+}
+
+TEST_CASE("Batched ray-sphere intersections", "[spheres]") {
+    std::vector<Sphere> spheres(3);
+    spheres[0].transform = translation(0, 0, 5);
+    spheres[1].transform = translation(3, 0, 0) * scaling(2, 2, 2);
+    spheres[2].transform = translation(0, 0, -10);
+    SphereBatch batch(spheres);
+    REQUIRE(batch.size() == 3);
+
+    RayPacket packet;
+    for (int i = 0; i < 37; i++) {
+        float y = (i % 5) * 0.3f;
+        float x = (i % 7) - 2.0f;
+        packet.push_back({point(x, y, -3), normalize(vector(0.1f * (i % 3), 0.05f, 1))});
+    }
+
+    std::vector<float> t(packet.size());
+    std::vector<int> object(packet.size());
+    intersect(batch, packet, t, object);
+
+    // matches intersecting the rays one at a time
+    Intersections xs;
+    for (int i = 0; i < packet.size(); i++) {
+        xs.clear();
+        intersect(spheres, packet.at(i), xs);
+        const Intersection* h = hit(xs);
+        if (h) {
+            CHECK(object[i] == h->object - spheres.data());
+            CHECK(std::abs(t[i] - h->t) < 0.0001);
+        } else {
+            CHECK(object[i] == -1);
+        }
+    }
+}
+
+TEST_CASE("Bounding boxes", "[bounds]") {
+    SECTION("An empty box grows to contain what is merged into it") {
+        Bounds b;
+        REQUIRE(b.empty());
+        b = merge(b, point(1, -2, 3));
+        b = merge(b, point(-1, 4, 0));
+        REQUIRE(!b.empty());
+        REQUIRE(b.min == point(-1, -2, 0));
+        REQUIRE(b.max == point(1, 4, 3));
+        REQUIRE(b.centroid() == point(0, 1, 1.5));
+        REQUIRE(b.surface_area() == 2 * (2 * 6 + 6 * 3 + 3 * 2));
+    }
+
+    SECTION("Bounds of a transformed sphere") {
+        Sphere s;
+        s.transform = translation(1, 2, 3) * scaling(2, 1, 1);
+        Bounds b = bounds(s);
+        REQUIRE(b.min == point(-1, 1, 2));
+        REQUIRE(b.max == point(3, 3, 4));
+
+        // a rotated box grows to hold the rotated corners
+        s.transform = rotation_z(M_PI / 4);
+        b = bounds(s);
+        REQUIRE(std::abs(b.max.x - std::sqrt(2.0f)) < 0.0001);
+        REQUIRE(std::abs(b.min.y + std::sqrt(2.0f)) < 0.0001);
+    }
+
+    SECTION("Rays against boxes") {
+        Bounds b {point(-1, -1, -1), point(1, 1, 1)};
+        Tuple inv_dir = vector(1 / 0.0f, 1 / 0.0f, 1);
+        REQUIRE(intersects(b, point(0, 0, -5), inv_dir, INFINITY));
+        REQUIRE(!intersects(b, point(0, 0, -5), inv_dir, 3));
+        REQUIRE(!intersects(b, point(2, 0, -5), inv_dir, INFINITY));
+        REQUIRE(!intersects(b, point(0, 0, 5), inv_dir, INFINITY));
+    }
+}
+
+TEST_CASE("Bounding volume hierarchy", "[bvh]") {
+    // deterministic pseudo-random scene
+    unsigned seed = 12345;
+    auto random = [&seed](float lo, float hi) {
+        seed = seed * 1664525u + 1013904223u;
+        return lo + (hi - lo) * ((seed >> 8) / 16777216.0f);
+    };
+
+    std::vector<Sphere> spheres(2000);
+    for (Sphere& s : spheres) {
+        float r = random(0.05f, 0.5f);
+        s.transform = translation(random(-20, 20), random(-20, 20), random(-20, 20)) 
+            * scaling(r, r, r);
+    }
+    Bvh bvh(spheres);
+
+    SECTION("Every sphere ends up in exactly one leaf") {
+        std::vector<int> seen(spheres.size());
+        int leaves = 0;
+        for (const BvhNode& node : bvh.nodes) {
+            if (node.count == 0) continue;
+            leaves++;
+            for (int i = node.offset; i < node.offset + node.count; i++) {
+                seen[bvh.primitives[i]]++;
+            }
+        }
+        REQUIRE(std::count(seen.begin(), seen.end(), 1) == 2000);
+        REQUIRE(leaves == bvh.build_stats.leaves);
+        REQUIRE(bvh.build_stats.nodes == static_cast<int>(bvh.nodes.size()));
+        REQUIRE(bvh.build_stats.max_depth < 40);
+        REQUIRE(bvh.build_stats.build_ms >= 0);
+    }
+
+    SECTION("The closest hit matches testing every sphere") {
+        BvhTraversalStats stats;
+        Intersections xs;
+        int hits = 0;
+        for (int i = 0; i < 500; i++) {
+            Ray r {point(random(-25, 25), random(-25, 25), -30), 
+                   normalize(vector(random(-0.3, 0.3), random(-0.3, 0.3), 1))};
+            std::optional<Intersection> h = bvh.closest_hit(r, &stats);
+
+            xs.clear();
+            intersect(spheres, r, xs);
+            const Intersection* expected = hit(xs);
+            REQUIRE(h.has_value() == (expected != nullptr));
+            if (h) {
+                hits++;
+                CHECK(h->object == expected->object);
+                CHECK(std::abs(h->t - expected->t) < 0.0001);
+            }
+        }
+        REQUIRE(hits > 0);
+        REQUIRE(stats.rays == 500);
+        // far fewer tests than the 2000 spheres a linear scan needs
+        REQUIRE(stats.primitives_per_ray() < 200);
+        REQUIRE(stats.nodes_per_ray() < bvh.nodes.size());
+    }
+
+    SECTION("An empty hierarchy is never hit") {
+        Bvh empty(std::span<const Sphere> {});
+        REQUIRE(!empty.closest_hit({point(0, 0, 0), vector(0, 0, 1)}));
+    }
+}
+
+TEST_CASE("Cached transforms", "[transformations]") {
+    SECTION("The inverse is computed on first use and kept") {
+        CachedTransform t = translation(1, 2, 3) * scaling(2, 2, 2);
+        REQUIRE(!t.cached());
+        REQUIRE(t.inverse() == inverse(t.matrix()));
+        REQUIRE(t.cached());
+        REQUIRE(&t.inverse() == &t.inverse());
+        REQUIRE(t.inverse_transpose() == transpose(inverse(t.matrix())));
+    }
+
+    SECTION("Setting the matrix invalidates the cache") {
+        CachedTransform t = translation(1, 2, 3);
+        REQUIRE(t.inverse() == translation(-1, -2, -3));
+        t = scaling(2, 4, 8);
+        REQUIRE(!t.cached());
+        REQUIRE(t.inverse() == scaling(0.5, 0.25, 0.125));
+    }
+
+    SECTION("Copies keep the cached inverse") {
+        CachedTransform t = rotation_x(0.5);
+        t.inverse();
+        CachedTransform copy = t;
+        REQUIRE(copy.cached());
+        REQUIRE(copy.inverse() == t.inverse());
+    }
+
+    SECTION("Many threads can ask for the inverse at once") {
+        CachedTransform t = rotation_y(0.3) * translation(4, 5, 6);
+        Mat4 expected = inverse(t.matrix());
+        std::atomic<int> wrong {0};
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 8; i++) {
+            threads.emplace_back([&] {
+                if (t.inverse() != expected) wrong++;
+            });
+        }
+        for (std::thread& th : threads) th.join();
+        REQUIRE(wrong == 0);
+    }
+}
+
+TEST_CASE("Normals on spheres", "[spheres]") {
+    Sphere s;
+
+    SECTION("The normal on a sphere at points on the axes") {
+        REQUIRE(normal_at(s, point(1, 0, 0)) == vector(1, 0, 0));
+        REQUIRE(normal_at(s, point(0, 1, 0)) == vector(0, 1, 0));
+        REQUIRE(normal_at(s, point(0, 0, 1)) == vector(0, 0, 1));
+    }
+
+    SECTION("The normal is a normalized vector") {
+        float v = std::sqrt(3.0f) / 3;
+        Tuple n = normal_at(s, point(v, v, v));
+        REQUIRE(n == vector(v, v, v));
+        REQUIRE(n == normalize(n));
+    }
+
+    SECTION("Computing the normal on a translated sphere") {
+        s.transform = translation(0, 1, 0);
+        Tuple n = normal_at(s, point(0, 1.70711, -0.70711));
+        REQUIRE(std::abs(n.y - 0.70711) < 0.0001);
+        REQUIRE(std::abs(n.z + 0.70711) < 0.0001);
+    }
+
+    SECTION("Computing the normal on a transformed sphere") {
+        s.transform = scaling(1, 0.5, 1) * rotation_z(M_PI / 5);
+        Tuple n = normal_at(s, point(0, std::sqrt(2) / 2, -std::sqrt(2) / 2));
+        REQUIRE(std::abs(n.x) < 0.0001);
+        REQUIRE(std::abs(n.y - 0.97014) < 0.0001);
+        REQUIRE(std::abs(n.z + 0.24254) < 0.0001);
+        REQUIRE(n.w == 0);
+    }
+}
+
+TEST_CASE("Affine transformations", "[affine]") {
+    Mat4 m = translation(1, -2, 3) * rotation_y(0.4) * scaling(2, 3, 0.5) 
+        * shearing(0.5, 0, 0, 1, 0, 0);
+    Affine a = to_affine(m);
+
+    auto close = [](const Tuple& t1, const Tuple& t2) {
+        return std::abs(t1.x - t2.x) < 0.0001 && std::abs(t1.y - t2.y) < 0.0001
+            && std::abs(t1.z - t2.z) < 0.0001 && t1.w == t2.w;
+    };
+
+    SECTION("Converting between Affine and Mat4") {
+        REQUIRE(isAffine(m));
+        REQUIRE(!isAffine(to_mat4({{ 1 , 0 , 0 , 0 },
+                                   { 0 , 1 , 0 , 0 },
+                                   { 0 , 0 , 1 , 0 },
+                                   { 0 , 0 , 1 , 0 } })));
+        REQUIRE(to_mat4(a) == m);
+        REQUIRE(to_affine(matrices::identity4) == matrices::identity_affine);
+    }
+
+    SECTION("Transforming points and vectors") {
+        Tuple p = point(1, 2, 3);
+        Tuple v = vector(-1, 0.5, 2);
+        REQUIRE(close(transform_point(a, p), m * p));
+        REQUIRE(close(transform_vector(a, v), m * v));
+        REQUIRE(close(a * p, m * p));
+        REQUIRE(close(a * v, m * v));
+        REQUIRE(transform_vector(to_affine(translation(5, 5, 5)), v) == v);
+    }
+
+    SECTION("Composing affine transforms") {
+        Affine b = to_affine(rotation_x(1.2) * translation(0, 4, -1));
+        Mat4 expected = m * to_mat4(b);
+        REQUIRE(to_mat4(a * b) == expected);
+
+        // general matrices stay general
+        Mat4 projective = to_mat4({{ 1 , 0 , 0 , 0 },
+                                   { 0 , 1 , 0 , 0 },
+                                   { 0 , 0 , 1 , 0 },
+                                   { 0 , 0 , 0.5 , 1 } });
+        REQUIRE(projective * a == projective * m);
+        REQUIRE(a * projective == m * projective);
+    }
+
+    SECTION("Inverting affine transforms") {
+        REQUIRE(std::abs(determinant(a) - determinant(m)) < 0.0001);
+        REQUIRE(isInvertible(a));
+
+        Affine inv = inverse(a);
+        Mat4 expected = inverse(m);
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 4; j++) {
+                CHECK(std::abs(inv[i][j] - expected[i][j]) < 0.0001);
+            }
+        }
+        Tuple p = point(-3, 2, 7);
+        REQUIRE(close(transform_point(inv, transform_point(a, p)), p));
+
+        constexpr Affine moved = to_affine(translation(1, 2, 3));
+        static_assert(inverse(moved)[0][3] == -1 && inverse(moved)[2][3] == -3);
+
+        Affine flat = to_affine(scaling(1, 0, 1));
+        REQUIRE(!isInvertible(flat));
+        REQUIRE(!checked_inverse(flat));
+        REQUIRE(checked_inverse(a));
+    }
+
+    SECTION("Transforming a ray") {
+        Ray r {point(1, 2, 3), vector(0, 1, 0)};
+        Ray r2 = transform(r, a);
+        Ray r3 = transform(r, m);
+        REQUIRE(close(r2.origin, r3.origin));
+        REQUIRE(close(r2.direction, r3.direction));
+    }
+}
+
+TEST_CASE("Bulk tuple transforms", "[tuple_batch]") {
+    Mat4 m = translation(1, -2, 3) * rotation_y(0.7) * scaling(2, 1, 0.5);
+    auto close = [](const Tuple& t1, const Tuple& t2) {
+        return std::abs(t1.x - t2.x) < 0.0001 && std::abs(t1.y - t2.y) < 0.0001
+            && std::abs(t1.z - t2.z) < 0.0001 && std::abs(t1.w - t2.w) < 0.0001;
+    };
+    // mixes points and vectors, with a length that is not a multiple of 8
+    auto make_batch = [](int n) {
+        TupleBatch b;
+        for (int i = 0; i < n; i++) {
+            float f = i * 0.01f;
+            b.push_back(i % 2 ? point(f, 1 - f, 2 * f) : vector(-f, f, 3));
+        }
+        return b;
+    };
+
+    SECTION("Storing tuples") {
+        TupleBatch b;
+        b.push_back(point(1, 2, 3));
+        b.push_back(vector(4, 5, 6));
+        REQUIRE(b.size() == 2);
+        REQUIRE(b.at(0) == point(1, 2, 3));
+        REQUIRE(b.at(1) == vector(4, 5, 6));
+        b.clear();
+        REQUIRE(b.size() == 0);
+    }
+
+    SECTION("Matches multiplying one tuple at a time") {
+        TupleBatch in = make_batch(1003);
+        TupleBatch out;
+        transform(m, in, out);
+        REQUIRE(out.size() == in.size());
+        for (int i = 0; i < in.size(); i++) {
+            CHECK(close(out.at(i), m * in.at(i)));
+        }
+    }
+
+    SECTION("Transforming in place") {
+        TupleBatch b = make_batch(37);
+        TupleBatch copy = b;
+        transform(m, b, b);
+        for (int i = 0; i < b.size(); i++) {
+            CHECK(close(b.at(i), m * copy.at(i)));
+        }
+    }
+
+    SECTION("Large batches are split across threads") {
+        ThreadPool pool(4);
+        BatchOptions options;
+        options.parallel_threshold = 0;
+        options.pool = &pool;
+
+        TupleBatch in = make_batch(100003);
+        TupleBatch parallel, serial;
+        transform(m, in, parallel, options);
+        options.parallel_threshold = in.size() + 1;
+        transform(m, in, serial, options);
+        REQUIRE(parallel.x == serial.x);
+        REQUIRE(parallel.y == serial.y);
+        REQUIRE(parallel.z == serial.z);
+        REQUIRE(parallel.w == serial.w);
+    }
+}
+
+TEST_CASE("Memory-mapped canvas", "[mapped_canvas]") {
+    std::string path = (std::filesystem::temp_directory_path() 
+        / "ray-tracer-mapped-canvas-test").string();
+
+    SECTION("Untouched pixels are black") {
+        MappedCanvas c(path, 10, 20);
+        REQUIRE(c.width == 10);
+        REQUIRE(c.height == 20);
+        REQUIRE(c.pixel_at(0, 0) == color(0, 0, 0));
+        REQUIRE(c.pixel_at(9, 19) == color(0, 0, 0));
+    }
+
+    SECTION("Writing pixels across tiles") {
+        MappedCanvas c(path, 50, 30, 16);
+        c.write_pixel(2, 3, color(1, 0, 0));
+        c.write_pixel(17, 3, color(0, 1, 0));
+        c.write_pixel(49, 29, color(0, 0, 1));
+        REQUIRE(c.pixel_at(2, 3) == color(1, 0, 0));
+        REQUIRE(c.pixel_at(17, 3) == color(0, 1, 0));
+        REQUIRE(c.pixel_at(49, 29) == color(0, 0, 1));
+        REQUIRE(c.pixel_at(3, 3) == color(0, 0, 0));
+
+        std::span<Tuple> part = c.tile_row(20, 5);
+        REQUIRE(part.size() == 12);
+        part[0] = color(0.5, 0.5, 0.5);
+        REQUIRE(c.pixel_at(20, 5) == color(0.5, 0.5, 0.5));
+        REQUIRE(c.tile_row(48, 0).size() == 2);
+    }
+
+    SECTION("Encodes the same PPM as an in-memory canvas") {
+        MappedCanvas mapped(path, 77, 45, 16);
+        Canvas canvas(77, 45);
+        for (int y = 0; y < 45; y++) {
+            for (int x = 0; x < 77; x++) {
+                Tuple c = color(x / 77.0f, y / 45.0f, (x + y) % 3 * 0.5f);
+                mapped.write_pixel(x, y, c);
+                canvas.write_pixel(x, y, c);
+            }
+        }
+
+        std::ostringstream p3, p6, expected_p6;
+        mapped.write_ppm(p3, PpmFormat::P3);
+        mapped.write_ppm(p6, PpmFormat::P6);
+        canvas.write_ppm(expected_p6, PpmFormat::P6);
+        REQUIRE(p3.str() == canvas.to_ppm());
+        REQUIRE(p6.str() == expected_p6.str());
+
+        // encoding released the pages but the pixels are still there
+        REQUIRE(mapped.pixel_at(76, 44) == canvas.pixel_at(76, 44));
+        mapped.sync();
+    }
+
+    SECTION("Encoding bands that do not start on a page boundary") {
+        // 5 tiles of 8x8 make 5120-byte bands, so most bands share a page
+        // with their neighbours
+        MappedCanvas mapped(path, 37, 150, 8);
+        Canvas canvas(37, 150);
+        for (int y = 0; y < 150; y++) {
+            for (int x = 0; x < 37; x++) {
+                Tuple c = color(x / 37.0f, y / 150.0f, 0.25f);
+                mapped.write_pixel(x, y, c);
+                canvas.write_pixel(x, y, c);
+            }
+        }
+
+        std::ostringstream p6, expected_p6;
+        mapped.write_ppm(p6, PpmFormat::P6);
+        canvas.write_ppm(expected_p6, PpmFormat::P6);
+        REQUIRE(p6.str() == expected_p6.str());
+        REQUIRE(mapped.pixel_at(0, 75) == canvas.pixel_at(0, 75));
+        REQUIRE(mapped.pixel_at(36, 149) == canvas.pixel_at(36, 149));
+    }
+
+    SECTION("Rendering whole tiles") {
+        MappedCanvas mapped(path, 50, 30, 16);
+        Canvas canvas(50, 30);
+        ThreadPool pool(3);
+        auto shade = [](int x, int y) { return color(x / 50.0f, y / 30.0f, 0.5f); };
+        // rounded up to 16x16 render tiles
+        render(mapped, shade, {5, &pool});
+        render(canvas, shade, {5, &pool});
+
+        bool same = true;
+        for (int y = 0; y < 30; y++) {
+            for (int x = 0; x < 50; x++) {
+                same = same && mapped.pixel_at(x, y) == canvas.pixel_at(x, y);
+            }
+        }
+        REQUIRE(same);
+    }
+
+    SECTION("Failing to create the file throws") {
+        REQUIRE_THROWS_AS(MappedCanvas("/nonexistent-dir/image", 4, 4), 
+            std::system_error);
+    }
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Compact pixel formats", "[canvas]") {
+    auto close = [](const Tuple& a, const Tuple& b, float eps) {
+        return std::abs(a.x - b.x) < eps && std::abs(a.y - b.y) < eps
+            && std::abs(a.z - b.z) < eps;
+    };
+
+    SECTION("Pixel sizes") {
+        REQUIRE(sizeof(Rgb8) == 3);
+        REQUIRE(sizeof(Rgb16f) == 6);
+        REQUIRE(sizeof(Rgb32f) == 12);
+    }
+
+    SECTION("Half floats") {
+        REQUIRE(to_half(0.0f) == 0);
+        REQUIRE(to_half(1.0f) == 0x3c00);
+        REQUIRE(to_half(-2.0f) == 0xc000);
+        REQUIRE(to_half(65504.0f) == 0x7bff);
+        REQUIRE(to_half(1e6f) == 0x7c00);
+        REQUIRE(to_half(5.9604645e-8f) == 1);
+        REQUIRE(from_half(0x3c00) == 1.0f);
+        REQUIRE(std::abs(from_half(0x3555) - 0.33325195f) < 1e-7);
+        REQUIRE(from_half(1) == 5.9604645e-8f);
+        REQUIRE(std::isinf(from_half(0x7c00)));
+        REQUIRE(std::isnan(from_half(to_half(std::nanf("")))));
+        // every finite half survives the round trip
+        for (int h = 0; h < 0x7c00; h++) {
+            CHECK(to_half(from_half(h)) == h);
+        }
+    }
+
+    SECTION("Colors are converted when written") {
+        Tuple c = color(0.2, 0.5, 1.5);
+
+        Rgb8Canvas c8(4, 3);
+        c8.write_pixel(1, 2, c);
+        REQUIRE(c8.row(2)[1].r == 51);
+        REQUIRE(c8.row(2)[1].b == 255);
+        REQUIRE(close(c8.pixel_at(1, 2), color(0.2, 0.5, 1), 0.002));
+        REQUIRE(c8.pixel_at(0, 0) == color(0, 0, 0));
+
+        Rgb16fCanvas c16(4, 3, color(1, 1, 1));
+        c16.write_pixel(3, 0, c);
+        REQUIRE(close(c16.pixel_at(3, 0), c, 0.001));
+        REQUIRE(c16.pixel_at(0, 0) == color(1, 1, 1));
+
+        Rgb32fCanvas c32(4, 3);
+        c32.write_pixel(0, 1, c);
+        REQUIRE(c32.pixel_at(0, 1) == c);
+    }
+
+    SECTION("Every format encodes the same PPM") {
+        Canvas full(23, 9);
+        Rgb8Canvas c8(23, 9);
+        Rgb16fCanvas c16(23, 9);
+        Rgb32fCanvas c32(23, 9);
+        for (int y = 0; y < 9; y++) {
+            for (int x = 0; x < 23; x++) {
+                // exact in 8 bits, so no format rounds differently
+                Tuple c = color(x * 10 / 255.0f, y * 25 / 255.0f, (x + y) % 2);
+                full.write_pixel(x, y, c);
+                c8.write_pixel(x, y, c);
+                c16.write_pixel(x, y, c);
+                c32.write_pixel(x, y, c);
+            }
+        }
+        std::string expected = full.to_ppm();
+        REQUIRE(c8.to_ppm() == expected);
+        REQUIRE(c16.to_ppm() == expected);
+        REQUIRE(c32.to_ppm() == expected);
+
+        std::ostringstream p6_full, p6_8;
+        full.write_ppm(p6_full, PpmFormat::P6);
+        c8.write_ppm(p6_8, PpmFormat::P6);
+        REQUIRE(p6_8.str() == p6_full.str());
+    }
+
+    SECTION("Rendering into a compact canvas") {
+        Rgb8Canvas c(40, 20);
+        render(c, [](int x, int y) { return color(x / 40.0, y / 20.0, 1); });
+        REQUIRE(c.row(10)[20].r == to_byte(0.5));
+        REQUIRE(c.row(10)[20].g == to_byte(0.5));
+    }
+}
+
+TEST_CASE("QOI and PNG encoders", "[encoders]") {
+    // gradients, flat runs and repeated colors exercise every QOI op
+    Canvas c(37, 21);
+    for (int y = 0; y < 21; y++) {
+        for (int x = 0; x < 37; x++) {
+            Tuple col = color(x / 36.0, y / 20.0, 0.5);
+            if (y % 5 == 0) col = color(1, 1, 1);
+            if (x > 30) col = color(x % 2, 0, 1);
+            if (y == 7) col = color((x * 37 % 256) / 255.0, (x * 91 % 256) / 255.0, 0);
+            c.write_pixel(x, y, col);
+        }
+    }
+    std::vector<Rgb8> expected(37 * 21);
+    to_rgb8(c.data(), expected.data());
+
+    auto u32 = [](const std::string& s, size_t i) {
+        return static_cast<std::uint32_t>(static_cast<unsigned char>(s[i])) << 24
+            | static_cast<unsigned char>(s[i + 1]) << 16 
+            | static_cast<unsigned char>(s[i + 2]) << 8 
+            | static_cast<unsigned char>(s[i + 3]);
+    };
+
+    SECTION("Checksums") {
+        const std::uint8_t* digits = reinterpret_cast<const std::uint8_t*>("123456789");
+        REQUIRE(crc32(0, digits, 9) == 0xcbf43926);
+        REQUIRE(crc32(crc32(0, digits, 4), digits + 4, 5) == 0xcbf43926);
+        REQUIRE(adler32(1, digits, 9) == 0x091e01de);
+        REQUIRE(adler32_combine(adler32(1, digits, 4), adler32(1, digits + 4, 5), 5) 
+            == 0x091e01de);
+        REQUIRE(adler32_combine(1, adler32(1, digits, 9), 9) == 0x091e01de);
+    }
+
+    SECTION("QOI decodes back to the canvas") {
+        std::ostringstream out;
+        write_qoi(out, c);
+        std::string q = out.str();
+
+        REQUIRE(q.substr(0, 4) == "qoif");
+        REQUIRE(u32(q, 4) == 37);
+        REQUIRE(u32(q, 8) == 21);
+        REQUIRE(q[12] == 3);
+        REQUIRE(q.substr(q.size() - 8) == std::string("\0\0\0\0\0\0\0\1", 8));
+        REQUIRE(q.size() < 14 + 37 * 21 * 4);
+
+        // minimal decoder for 3-channel images
+        std::vector<Rgb8> pixels;
+        Rgb8 index[64] = {};
+        Rgb8 px {0, 0, 0};
+        size_t i = 14;
+        while (pixels.size() < expected.size()) {
+            int b = static_cast<unsigned char>(q[i++]);
+            if (b == 0xfe) {
+                px = {std::uint8_t(q[i]), std::uint8_t(q[i + 1]), std::uint8_t(q[i + 2])};
+                i += 3;
+            } else if ((b & 0xc0) == 0x00) {
+                px = index[b];
+            } else if ((b & 0xc0) == 0x40) {
+                px.r += ((b >> 4) & 3) - 2;
+                px.g += ((b >> 2) & 3) - 2;
+                px.b += (b & 3) - 2;
+            } else if ((b & 0xc0) == 0x80) {
+                int dg = (b & 0x3f) - 32;
+                int next = static_cast<unsigned char>(q[i++]);
+                px.r += dg + (next >> 4) - 8;
+                px.g += dg;
+                px.b += dg + (next & 15) - 8;
+            } else {
+                for (int r = 0; r < (b & 0x3f); r++) pixels.push_back(px);
+            }
+            index[(px.r * 3 + px.g * 5 + px.b * 7 + 255 * 11) % 64] = px;
+            pixels.push_back(px);
+        }
+        REQUIRE(i == q.size() - 8);
+        REQUIRE(pixels.size() == expected.size());
+        for (size_t p = 0; p < pixels.size(); p++) {
+            CHECK(pixels[p].r == expected[p].r);
+            CHECK(pixels[p].g == expected[p].g);
+            CHECK(pixels[p].b == expected[p].b);
+        }
+    }
+
+    SECTION("PNG chunks and image data are valid") {
+        ThreadPool pool(3);
+        PngOptions options;
+        options.band_rows = 4;
+        options.pool = &pool;
+
+        Rgb8Canvas c8(37, 21);
+        for (int y = 0; y < 21; y++) {
+            for (int x = 0; x < 37; x++) c8.write_pixel(x, y, c.pixel_at(x, y));
+        }
+        std::ostringstream out, out8;
+        write_png(out, c, options);
+        write_png(out8, c8, options);
+        std::string png = out.str();
+        REQUIRE(png == out8.str());
+        REQUIRE(png.substr(0, 8) == "\x89PNG\r\n\x1a\n");
+
+        // walk the chunks, checking each CRC and joining the IDAT data
+        std::string zlib;
+        std::vector<std::string> types;
+        size_t i = 8;
+        while (i < png.size()) {
+            std::uint32_t length = u32(png, i);
+            std::string type = png.substr(i + 4, 4);
+            const std::uint8_t* body = reinterpret_cast<const std::uint8_t*>(png.data() + i + 4);
+            CHECK(crc32(0, body, length + 4) == u32(png, i + 8 + length));
+            if (type == "IDAT") zlib += png.substr(i + 8, length);
+            if (type == "IHDR") {
+                REQUIRE(u32(png, i + 8) == 37);
+                REQUIRE(u32(png, i + 12) == 21);
+            }
+            types.push_back(type);
+            i += 12 + length;
+        }
+        REQUIRE(i == png.size());
+        REQUIRE(types.front() == "IHDR");
+        REQUIRE(types.back() == "IEND");
+        REQUIRE(types.size() == 2 + 6 + 1);      // 6 bands and the stream end
+
+        // unpack the stored deflate blocks
+        REQUIRE((static_cast<unsigned char>(zlib[0]) * 256 
+            + static_cast<unsigned char>(zlib[1])) % 31 == 0);
+        std::string raw;
+        size_t p = 2;
+        bool last = false;
+        while (!last) {
+            last = zlib[p] & 1;
+            REQUIRE((zlib[p] & 6) == 0);
+            size_t n = static_cast<unsigned char>(zlib[p + 1]) 
+                | static_cast<unsigned char>(zlib[p + 2]) << 8;
+            raw += zlib.substr(p + 5, n);
+            p += 5 + n;
+        }
+        REQUIRE(p + 4 == zlib.size());
+        REQUIRE(adler32(1, reinterpret_cast<const std::uint8_t*>(raw.data()), raw.size()) 
+            == u32(zlib, p));
+
+        REQUIRE(raw.size() == 21 * (1 + 37 * 3));
+        for (int y = 0; y < 21; y++) {
+            const char* row = raw.data() + y * (1 + 37 * 3);
+            CHECK(row[0] == 0);
+            REQUIRE(std::memcmp(row + 1, expected.data() + y * 37, 37 * 3) == 0);
+        }
+    }
+
+    SECTION("Writing to a file descriptor") {
+        FILE* f = std::tmpfile();
+        REQUIRE(f != nullptr);
+        write_png(fileno(f), c);
+        std::rewind(f);
+        std::string png;
+        char buf[256];
+        size_t n;
+        while ((n = std::fread(buf, 1, sizeof buf, f)) > 0) {
+            png.append(buf, n);
+        }
+        std::ostringstream expected_png;
+        write_png(expected_png, c);
+        REQUIRE(png == expected_png.str());
+        std::fclose(f);
+    }
+}
+
+TEST_CASE("Pipelined render and encode", "[pipeline]") {
+    auto shade = [](int x, int y) {
+        return color(x / 50.0, y / 30.0, (x * y) % 7 / 7.0);
+    };
+    Canvas expected(50, 30);
+    render(expected, shade);
+
+    SECTION("Lock-free queue") {
+        SpscQueue<int> q(3);
+        int v;
+        REQUIRE(!q.pop(v));
+        for (int i = 0; i < 4; i++) REQUIRE(q.push(i));
+        REQUIRE(!q.push(4));
+        REQUIRE(q.pop(v));
+        REQUIRE(v == 0);
+        REQUIRE(q.push(4));
+        for (int i = 1; i <= 4; i++) {
+            REQUIRE(q.pop(v));
+            REQUIRE(v == i);
+        }
+
+        // values arrive in order across threads
+        SpscQueue<int> shared(8);
+        const int count = 100000;
+        std::thread consumer([&] {
+            long sum = 0;
+            int next = 0;
+            bool ordered = true;
+            while (next < count) {
+                int got;
+                shared.wait_for_item();
+                while (shared.pop(got)) {
+                    ordered = ordered && got == next;
+                    sum += got;
+                    next++;
+                }
+            }
+            CHECK(ordered);
+            CHECK(sum == static_cast<long>(count) * (count - 1) / 2);
+        });
+        for (int i = 0; i < count; i++) {
+            while (!shared.push(i)) shared.wait_for_room();
+        }
+        consumer.join();
+    }
+
+    SECTION("Produces the same PPM as rendering then encoding") {
+        ThreadPool pool(3);
+        for (PpmFormat format : {PpmFormat::P3, PpmFormat::P6}) {
+            PipelineOptions options;
+            options.band_rows = 7;
+            options.queued_bands = 2;
+            options.format = format;
+            options.render.pool = &pool;
+            options.render.tile_size = 8;
+
+            std::ostringstream out, reference;
+            PipelineStats stats = render_ppm(out, 50, 30, shade, options);
+            expected.write_ppm(reference, format);
+            REQUIRE(out.str() == reference.str());
+            REQUIRE(stats.bands == 5);
+            REQUIRE(stats.total_ms >= stats.writer_busy_ms);
+            REQUIRE(stats.writer_stall_ms >= 0);
+            REQUIRE(stats.render_stall_ms >= 0);
+        }
+    }
+
+    SECTION("Writing to a file descriptor") {
+        FILE* f = std::tmpfile();
+        REQUIRE(f != nullptr);
+        render_ppm(fileno(f), 50, 30, shade);
+        std::rewind(f);
+        std::string ppm;
+        char buf[256];
+        size_t n;
+        while ((n = std::fread(buf, 1, sizeof buf, f)) > 0) {
+            ppm.append(buf, n);
+        }
+        std::fclose(f);
+        REQUIRE(ppm == expected.to_ppm());
+    }
+
+    SECTION("Writer errors reach the caller") {
+        REQUIRE_THROWS_AS(render_ppm(-1, 50, 30, shade), std::system_error);
+    }
+}
+
+TEST_CASE("Tiled canvas layout", "[canvas]") {
+    SECTION("Morton order within a tile") {
+        REQUIRE(TiledCanvas<Tuple>::morton(0, 0) == 0);
+        REQUIRE(TiledCanvas<Tuple>::morton(1, 0) == 1);
+        REQUIRE(TiledCanvas<Tuple>::morton(0, 1) == 2);
+        REQUIRE(TiledCanvas<Tuple>::morton(1, 1) == 3);
+        REQUIRE(TiledCanvas<Tuple>::morton(2, 0) == 4);
+        REQUIRE(TiledCanvas<Tuple>::morton(7, 7) == 63);
+        std::vector<bool> seen(64);
+        for (int y = 0; y < 8; y++) {
+            for (int x = 0; x < 8; x++) seen[TiledCanvas<Tuple>::morton(x, y)] = true;
+        }
+        REQUIRE(std::count(seen.begin(), seen.end(), true) == 64);
+    }
+
+    SECTION("Same pixels as a linear canvas") {
+        // sizes that are not multiples of the tile size
+        TiledCanvas<Tuple> tiled(21, 13);
+        Canvas linear(21, 13);
+        REQUIRE(tiled.pixel_at(20, 12) == color(0, 0, 0));
+        for (int y = 0; y < 13; y++) {
+            for (int x = 0; x < 21; x++) {
+                Tuple c = color(x / 21.0, y / 13.0, (x ^ y) % 5 / 5.0);
+                tiled.write_pixel(x, y, c);
+                linear.write_pixel(x, y, c);
+            }
+        }
+        for (int y = 0; y < 13; y++) {
+            std::vector<Tuple> row(21);
+            tiled.read_row(y, row);
+            for (int x = 0; x < 21; x++) {
+                CHECK(tiled.pixel_at(x, y) == linear.pixel_at(x, y));
+                CHECK(row[x] == linear.pixel_at(x, y));
+            }
+        }
+        REQUIRE(tiled.to_ppm() == linear.to_ppm());
+
+        std::ostringstream p6, expected_p6;
+        tiled.write_ppm(p6, PpmFormat::P6);
+        linear.write_ppm(expected_p6, PpmFormat::P6);
+        REQUIRE(p6.str() == expected_p6.str());
+    }
+
+    SECTION("Tiles are contiguous") {
+        TiledCanvas<Rgb8> c(16, 16);
+        c.write_pixel(9, 2, color(1, 1, 1));
+        std::span<Rgb8> t = c.tile(1, 0);
+        REQUIRE(t.size() == 64);
+        REQUIRE(t[TiledCanvas<Rgb8>::morton(1, 2)].r == 255);
+        t[0] = {0, 255, 0};
+        REQUIRE(c.pixel_at(8, 0) == color(0, 1, 0));
+    }
+
+    SECTION("Rendering into a tiled canvas") {
+        auto shade = [](int x, int y) { return color(x / 30.0, y / 20.0, 0.25); };
+        TiledCanvas<Tuple> tiled(30, 20);
+        Canvas linear(30, 20);
+        RenderOptions options;
+        options.tile_size = 5;      // rounded up to 8
+        render(tiled, shade, options);
+        render(linear, shade);
+        REQUIRE(tiled.to_ppm() == linear.to_ppm());
+    }
+}
+
+TEST_CASE("Tracing", "[trace]") {
+    trace::clear();
+
+    SECTION("Scopes from several threads become Chrome trace events") {
+        {
+            trace::Scope outer {"outer"};
+            trace::Scope inner {"inner \"quoted\""};
+        }
+        std::thread other([] {
+            trace::Scope s {"other thread"};
+            trace::count(trace::Counter::pixels_written, 10);
+        });
+        other.join();
+        trace::count(trace::Counter::inversions);
+        trace::count(trace::Counter::pixels_written, 5);
+
+        REQUIRE(trace::event_count() == 3);
+        REQUIRE(trace::dropped_count() == 0);
+        auto totals = trace::counters();
+        REQUIRE(totals[static_cast<int>(trace::Counter::inversions)] == 1);
+        REQUIRE(totals[static_cast<int>(trace::Counter::pixels_written)] == 15);
+
+        std::ostringstream json;
+        trace::write_chrome_json(json);
+        std::string j = json.str();
+        REQUIRE(j.rfind("{\"traceEvents\": [", 0) == 0);
+        REQUIRE(j.find("\"name\": \"outer\", \"ph\": \"X\"") != std::string::npos);
+        REQUIRE(j.find("\"inner \\\"quoted\\\"\"") != std::string::npos);
+        REQUIRE(j.find("\"other thread\"") != std::string::npos);
+        REQUIRE(j.find("\"pixels_written\": 15") != std::string::npos);
+
+        std::ostringstream summary;
+        trace::write_summary(summary);
+        REQUIRE(summary.str().find("outer: 1 calls") != std::string::npos);
+        REQUIRE(summary.str().find("inversions: 1") != std::string::npos);
+    }
+
+    SECTION("Clearing forgets events and counters") {
+        { trace::Scope s {"forgotten"}; }
+        trace::count(trace::Counter::matrix_multiplies, 3);
+        trace::clear();
+        REQUIRE(trace::event_count() == 0);
+        REQUIRE(trace::counters()[static_cast<int>(trace::Counter::matrix_multiplies)] == 0);
+    }
+
+#ifdef RAY_TRACER_TRACING
+    SECTION("Hot paths are instrumented") {
+        Mat4 m = translation(1, 2, 3) * scaling(2, 2, 2);
+        Mat4 inv = inverse(m);
+        Canvas c(4, 4);
+        c.write_pixel(1, 1, color(1, 0, 0));
+        c.to_ppm();
+        auto totals = trace::counters();
+        REQUIRE(totals[static_cast<int>(trace::Counter::matrix_multiplies)] >= 1);
+        REQUIRE(totals[static_cast<int>(trace::Counter::inversions)] == 1);
+        REQUIRE(totals[static_cast<int>(trace::Counter::pixels_written)] == 1);
+        std::ostringstream summary;
+        trace::write_summary(summary);
+        REQUIRE(summary.str().find("to_ppm: 1 calls") != std::string::npos);
+        REQUIRE(summary.str().find("inverse(Mat4): 1 calls") != std::string::npos);
+        (void)inv;
+    }
+#endif
+
+    trace::clear();
+}
+
+TEST_CASE("Double-precision tuples and matrices", "[precision]") {
+    SECTION("Epsilons follow the precision") {
+        REQUIRE(equal(1.0f, 1.00001f));
+        REQUIRE_FALSE(equal(1.0f, 1.001f));
+        REQUIRE_FALSE(equal(1.0, 1.00001));
+        REQUIRE(equal(1.0, 1.000000001));
+        REQUIRE_FALSE(equal(0.0f, 0.5f));
+    }
+
+    SECTION("Tuples and builders work in double") {
+        TupleD p = point<double>(1, -2, 3);
+        TupleD v = vector<double>(4, 5, 6);
+        REQUIRE(p + v == point<double>(5, 3, 9));
+        REQUIRE(dot(v, v) == 77.0);
+        REQUIRE(cross(vector<double>(1, 0, 0), vector<double>(0, 1, 0))
+            == vector<double>(0, 0, 1));
+
+        Mat4D m = translation<double>(10, 5, 7) * scaling<double>(5, 5, 5)
+            * rotation_x<double>(M_PI / 2);
+        Mat4D chain = TransformChainD().rotate_x(M_PI / 2).scale(5, 5, 5)
+            .translate(10, 5, 7);
+        REQUIRE(m == chain);
+        REQUIRE(m * point<double>(1, 0, 1) == point<double>(15, 0, 7));
+        REQUIRE(inverse(m) * (m * p) == p);
+
+        MatrixD big = m;
+        REQUIRE(to_mat4<double>(inverse(big)) == inverse(m));
+    }
+
+    SECTION("Double keeps small offsets at large coordinates") {
+        TupleD far = point<double>(1e6, 0, 0);
+        TupleD moved = translation<double>(0.001, 0, 0) * far;
+        REQUIRE(moved.x - far.x > 0.0009);
+
+        // float has 1/16 unit steps at 1e6, the offset is lost
+        Tuple far_f = point(1e6f, 0, 0);
+        Tuple moved_f = translation(0.001f, 0, 0) * far_f;
+        REQUIRE(moved_f.x == far_f.x);
+    }
+}
+
+TEST_CASE("Scene graph", "[scene]") {
+    Scene scene;
+    NodeId arm = scene.add_group(Scene::root, translation(0, 2, 0));
+    NodeId hand = scene.add_group(arm, rotation_z(M_PI / 2));
+    NodeId ball = scene.add_sphere(hand, translation(1, 0, 0));
+    NodeId other = scene.add_sphere(Scene::root, scaling(2, 2, 2));
+
+    SECTION("World transforms combine the parents' transforms") {
+        SceneUpdateStats stats = scene.update();
+        REQUIRE(stats.recomputed == 5);
+        REQUIRE(stats.reused == 0);
+        Mat4 expected = translation(0, 2, 0) * rotation_z(M_PI / 2) * translation(1, 0, 0);
+        REQUIRE(scene.world_transform(ball) == expected);
+        REQUIRE(scene.world_inverse(ball) == inverse(expected));
+        REQUIRE(scene.world_transform(ball) * point(0, 0, 0) == point(0, 3, 0));
+        REQUIRE(scene.parent(ball) == hand);
+        REQUIRE(scene.is_group(hand));
+        REQUIRE(!scene.is_group(ball));
+    }
+
+    SECTION("Spheres follow their nodes with the inverse cached") {
+        scene.update();
+        REQUIRE(scene.spheres().size() == 2);
+        const Sphere& s = scene.spheres()[0];
+        REQUIRE(scene.sphere_node(0) == ball);
+        REQUIRE(s.transform.cached());
+        REQUIRE(s.transform.matrix() == scene.world_transform(ball));
+        REQUIRE(normal_at(s, point(0, 4, 0)) == vector(0, 1, 0));
+        Intersections xs;
+        intersect(s, Ray {point(0, 3, -5), vector(0, 0, 1)}, xs);
+        REQUIRE(xs.size() == 2);
+        REQUIRE(equal(xs[0].t, 4));
+    }
+
+    SECTION("Only changed subtrees are recomputed") {
+        scene.update();
+        SceneUpdateStats idle = scene.update();
+        REQUIRE(idle.recomputed == 0);
+        REQUIRE(idle.reused == 5);
+
+        scene.set_transform(arm, translation(0, 5, 0));
+        REQUIRE(scene.dirty(arm));
+        SceneUpdateStats moved = scene.update();
+        REQUIRE(moved.recomputed == 3);
+        REQUIRE(moved.reused == 2);
+        // hand and ball only moved with arm
+        REQUIRE(moved.inversions == 1);
+        REQUIRE(!scene.dirty(arm));
+        REQUIRE(scene.world_transform(ball) * point(0, 0, 0) == point(0, 6, 0));
+        REQUIRE(scene.world_inverse(ball) == inverse(scene.world_transform(ball)));
+        REQUIRE(scene.spheres()[1].transform.matrix() == scaling(2, 2, 2));
+        REQUIRE(scene.last_update().recomputed == 3);
+    }
+
+    SECTION("Nodes are only added to groups") {
+        REQUIRE_THROWS_AS(scene.add_sphere(ball), std::invalid_argument);
+        REQUIRE_THROWS_AS(scene.add_group(42), std::invalid_argument);
+        (void)other;
+    }
+}
+
+TEST_CASE("Camera", "[camera]") {
+    SECTION("View transforms") {
+        REQUIRE(view_transform(point(0, 0, 0), point(0, 0, -1), vector(0, 1, 0))
+            == matrices::identity4);
+        REQUIRE(view_transform(point(0, 0, 0), point(0, 0, 1), vector(0, 1, 0))
+            == scaling(-1, 1, -1));
+        REQUIRE(view_transform(point(0, 0, 8), point(0, 0, 0), vector(0, 1, 0))
+            == translation(0, 0, -8));
+        Mat4 expected = to_mat4({{-0.50709, 0.50709, 0.67612, -2.36643},
+                                 {0.76772, 0.60609, 0.12122, -2.82843},
+                                 {-0.35857, 0.59761, -0.71714, 0.00000},
+                                 {0.00000, 0.00000, 0.00000, 1.00000}});
+        REQUIRE(view_transform(point(1, 3, 2), point(4, -2, 8), vector(1, 1, 0))
+            == expected);
+    }
+
+    SECTION("Pixel size") {
+        REQUIRE(equal(Camera(200, 125, M_PI / 2).pixel_size(), 0.01));
+        REQUIRE(equal(Camera(125, 200, M_PI / 2).pixel_size(), 0.01));
+    }
+
+    SECTION("Rays through the canvas") {
+        Camera c(201, 101, M_PI / 2);
+        Ray center = c.ray_for_pixel(100, 50);
+        REQUIRE(center.origin == point(0, 0, 0));
+        REQUIRE(center.direction == vector(0, 0, -1));
+        REQUIRE(c.ray_for_pixel(0, 0).direction == vector(0.66519, 0.33259, -0.66851));
+
+        c.set_transform(rotation_y(M_PI / 4) * translation(0, -2, 5));
+        Ray r = c.ray_for_pixel(100, 50);
+        REQUIRE(r.origin == point(0, 2, -5));
+        REQUIRE(r.direction == vector(std::sqrt(2) / 2, 0, -std::sqrt(2) / 2));
+    }
+
+    SECTION("Cached directions match the per-pixel inverse") {
+        Camera c(40, 30, 1.2f, view_transform(point(1, 2, -5), point(0, 1, 0), vector(0, 1, 0)));
+        Mat4 inv = inverse(c.transform());
+        bool same = true;
+        for (int py = 0; py < 30; py++) {
+            for (int px = 0; px < 40; px++) {
+                float x = c.pixel_size() * (20 - px - 0.5f);
+                float y = c.pixel_size() * (15 - py - 0.5f);
+                Tuple pixel = inv * point(x, y, -1);
+                Tuple origin = inv * point(0, 0, 0);
+                Ray r = c.ray_for_pixel(px, py);
+                same = same && r.origin == origin
+                    && r.direction == normalize(pixel - origin);
+            }
+        }
+        REQUIRE(same);
+    }
+
+    SECTION("Directions are only recomputed when the transform changes") {
+        Camera c(16, 16, M_PI / 3);
+        REQUIRE(c.direction_updates() == 1);
+        RayPacket rays;
+        for (int frame = 0; frame < 3; frame++) {
+            c.rays_for_tile({0, 0, 16, 16}, rays);
+        }
+        REQUIRE(c.direction_updates() == 1);
+        c.set_transform(translation(0, 0, -3));
+        REQUIRE(c.direction_updates() == 2);
+    }
+
+    SECTION("Transforms with a known inverse") {
+        Mat4 m = view_transform(point(3, 1, -4), point(0, 0, 0), vector(0, 1, 0));
+        Camera computed(20, 10, M_PI / 3);
+        Camera given(20, 10, M_PI / 3);
+        computed.set_transform(m);
+        given.set_transform(m, inverse(m));
+        REQUIRE(given.transform() == m);
+        REQUIRE(given.ray_for_pixel(0, 0).origin == computed.ray_for_pixel(0, 0).origin);
+        REQUIRE(given.ray_for_pixel(7, 3).direction == computed.ray_for_pixel(7, 3).direction);
+    }
+
+    SECTION("Tiles of rays") {
+        Camera c(20, 10, M_PI / 2, rotation_x(0.3f));
+        RayPacket rays;
+        rays.push_back(Ray {point(9, 9, 9), vector(1, 0, 0)});
+        c.rays_for_tile({4, 2, 9, 5}, rays);
+        REQUIRE(rays.size() == 15);
+        REQUIRE(rays.at(0).origin == c.ray_for_pixel(4, 2).origin);
+        REQUIRE(rays.at(0).direction == c.ray_for_pixel(4, 2).direction);
+        REQUIRE(rays.at(7).direction == c.ray_for_pixel(6, 3).direction);
+        REQUIRE(rays.at(14).direction == c.ray_for_pixel(8, 4).direction);
+    }
+
+    SECTION("Rendering through a camera") {
+        Camera c(32, 24, M_PI / 2);
+        Canvas canvas(32, 24);
+        ThreadPool pool(3);
+        render(canvas, c, [](const Ray& r) {
+            return r.direction.x > 0 ? color(1, 0, 0) : color(0, 0, 1);
+        }, {7, &pool});
+        // the camera looks down -z, so the left of the image is +x
+        REQUIRE(canvas.pixel_at(0, 5) == color(1, 0, 0));
+        REQUIRE(canvas.pixel_at(31, 20) == color(0, 0, 1));
+
+        Canvas bigger(33, 24);
+        auto black = [](const Ray&) { return color(0, 0, 0); };
+        REQUIRE_THROWS_AS(render(bigger, c, black, {7, &pool}), std::invalid_argument);
+    }
+}
+
+TEST_CASE("Lights and materials", "[lighting]") {
+    Material m;
+    Tuple position = point(0, 0, 0);
+
+    SECTION("Reflecting vectors") {
+        REQUIRE(reflect(vector(1, -1, 0), vector(0, 1, 0)) == vector(1, 1, 0));
+        float h = std::sqrt(2) / 2;
+        REQUIRE(reflect(vector(0, -1, 0), vector(h, h, 0)) == vector(1, 0, 0));
+    }
+
+    SECTION("Default material") {
+        Sphere s;
+        REQUIRE(s.material.color == color(1, 1, 1));
+        REQUIRE(s.material.ambient == 0.1f);
+        REQUIRE(s.material.diffuse == 0.9f);
+        REQUIRE(s.material.specular == 0.9f);
+        REQUIRE(s.material.shininess == 200);
+    }
+
+    SECTION("Phong lighting") {
+        Tuple normalv = vector(0, 0, -1);
+        float h = std::sqrt(2) / 2;
+        // eye between the light and the surface
+        REQUIRE(lighting(m, {point(0, 0, -10), color(1, 1, 1)}, position,
+            vector(0, 0, -1), normalv) == color(1.9, 1.9, 1.9));
+        // eye offset 45 degrees
+        REQUIRE(lighting(m, {point(0, 0, -10), color(1, 1, 1)}, position,
+            vector(0, h, -h), normalv) == color(1.0, 1.0, 1.0));
+        // light offset 45 degrees
+        REQUIRE(lighting(m, {point(0, 10, -10), color(1, 1, 1)}, position,
+            vector(0, 0, -1), normalv) == color(0.7364, 0.7364, 0.7364));
+        // eye in the path of the reflection
+        REQUIRE(lighting(m, {point(0, 10, -10), color(1, 1, 1)}, position,
+            vector(0, -h, -h), normalv) == color(1.6364, 1.6364, 1.6364));
+        // light behind the surface
+        REQUIRE(lighting(m, {point(0, 0, 10), color(1, 1, 1)}, position,
+            vector(0, 0, -1), normalv) == color(0.1, 0.1, 0.1));
+    }
+
+    SECTION("Approximate powers stay within their bounds") {
+        float worst_bounded = 0, worst_fast = 0;
+        for (float y : {1.0f, 3.5f, 10.0f, 200.0f, 1000.0f}) {
+            for (int i = 1; i <= 10000; i++) {
+                float x = i / 10000.0f;
+                double exact = std::pow(static_cast<double>(x), y);
+                if (exact < 1e-37) continue;
+                worst_bounded = std::max(worst_bounded, static_cast<float>(
+                    std::abs(specular_pow(x, y, PowMode::bounded) - exact) / exact));
+                worst_fast = std::max(worst_fast, static_cast<float>(
+                    std::abs(specular_pow(x, y, PowMode::fast) - exact) / exact));
+            }
+        }
+        REQUIRE(worst_bounded < 3e-5f);
+        REQUIRE(worst_fast < 0.015f);
+        REQUIRE(specular_pow(0.5f, 0, PowMode::fast) == 1);
+        REQUIRE(specular_pow(0, 200, PowMode::bounded) == 0);
+        REQUIRE(specular_pow(0.01f, 200, PowMode::bounded) == 0);
+    }
+
+    SECTION("Batched lighting matches lighting()") {
+        PointLight light {point(-10, 10, -10), color(1, 0.9, 0.8)};
+        HitBatch hits;
+        std::vector<Tuple> expected;
+        // 37 hits so the vector loop has a remainder
+        for (int i = 0; i < 37; i++) {
+            float a = i * 0.17f;
+            Tuple p = point(std::cos(a), std::sin(a), 0.3f * (i % 5));
+            Tuple normalv = normalize(vector(std::cos(a), std::sin(a), -0.5f));
+            Tuple eyev = normalize(vector(0.2f * (i % 3), -0.1f, -1));
+            Material mat;
+            mat.color = color(0.2f + 0.02f * i, 0.5, 1 - 0.02f * i);
+            mat.shininess = 10 + 20 * (i % 11);
+            hits.push_back(p, eyev, normalv, mat);
+            expected.push_back(lighting(mat, light, p, eyev, normalv));
+        }
+        REQUIRE(hits.size() == 37);
+
+        for (PowMode mode : {PowMode::exact, PowMode::bounded, PowMode::fast}) {
+            TupleBatch out;
+            lighting(light, hits, out, mode);
+            REQUIRE(out.size() == 37);
+            float worst = 0;
+            for (int i = 0; i < 37; i++) {
+                Tuple d = out.at(i) - expected[i];
+                worst = std::max({worst, std::abs(d.x), std::abs(d.y), std::abs(d.z)});
+            }
+            REQUIRE(worst < (mode == PowMode::fast ? 0.02f : 0.0001f));
+        }
+    }
+}
+
+TEST_CASE("Arena allocation", "[arena]") {
+    SECTION("Allocations are bumped out of blocks and taken back on reset") {
+        Arena arena(1024);
+        long before = Arena::heap_allocations();
+        char* a = static_cast<char*>(arena.allocate(10, 1));
+        double* b = arena.allocate<double>(4);
+        REQUIRE(reinterpret_cast<std::uintptr_t>(b) % alignof(double) == 0);
+        REQUIRE(reinterpret_cast<char*>(b) >= a + 10);
+        REQUIRE(arena.used() == 48);
+        REQUIRE(Arena::heap_allocations() == before + 1);
+
+        // bigger than a block
+        arena.allocate(4000);
+        REQUIRE(arena.capacity() == 1024 + 4000);
+
+        unsigned gen = arena.generation();
+        arena.reset();
+        REQUIRE(arena.generation() == gen + 1);
+        REQUIRE(arena.used() == 0);
+        REQUIRE(arena.allocate(10, 1) == a);
+        arena.allocate(1000);
+        arena.allocate(3000);
+        // every block is reused, nothing new from the heap
+        REQUIRE(Arena::heap_allocations() == before + 2);
+    }
+
+    SECTION("Rewinding frees only what came after the mark") {
+        Arena arena(256);
+        char* kept = static_cast<char*>(arena.allocate(100, 1));
+        Arena::Mark m = arena.mark();
+        char* first = static_cast<char*>(arena.allocate(100, 1));
+        // spills into a second block
+        arena.allocate(200, 1);
+        unsigned gen = arena.generation();
+        arena.rewind(m);
+        REQUIRE(arena.generation() == gen + 1);
+        REQUIRE(arena.used() == 100);
+        REQUIRE(arena.allocate(100, 1) == first);
+        REQUIRE(kept < first);
+    }
+
+    SECTION("Each thread has its own arena") {
+        Arena* here = &thread_arena();
+        Arena* there = nullptr;
+        std::thread t([&] { there = &thread_arena(); });
+        t.join();
+        REQUIRE(here == &thread_arena());
+        REQUIRE(here != there);
+    }
+}
+
+TEST_CASE("Small-buffer intersection lists", "[intersections]") {
+    Sphere s;
+
+    SECTION("Short lists stay inline") {
+        long before = Arena::heap_allocations();
+        Intersections xs;
+        for (int i = 0; i < Intersections::inline_capacity; i++) {
+            xs.push_back({static_cast<float>(i), &s});
+        }
+        REQUIRE(!xs.spilled());
+        REQUIRE(Arena::heap_allocations() == before);
+    }
+
+    SECTION("Long lists spill into their arena") {
+        Arena arena;
+        arena.allocate(1);
+        long before = Arena::heap_allocations();
+        Intersections xs(&arena);
+        for (int i = 0; i < 20; i++) xs.push_back({static_cast<float>(20 - i), &s});
+        REQUIRE(xs.spilled());
+        REQUIRE(xs.size() == 20);
+        REQUIRE(xs[19].t == 1);
+        REQUIRE(Arena::heap_allocations() == before);
+        sort_intersections(xs);
+        REQUIRE(xs[0].t == 1);
+        REQUIRE(hit(xs) == &xs[0]);
+
+        // keeps the spilled storage until the arena is reset
+        xs.clear();
+        REQUIRE(xs.spilled());
+        arena.reset();
+        xs.clear();
+        REQUIRE(!xs.spilled());
+        REQUIRE(xs.capacity() == Intersections::inline_capacity);
+    }
+
+    SECTION("Lists without an arena spill onto the counted heap") {
+        long before = Arena::heap_allocations();
+        Intersections xs;
+        for (int i = 0; i < 9; i++) xs.push_back({static_cast<float>(i), &s});
+        REQUIRE(Arena::heap_allocations() == before + 1);
+        Intersections copy = xs;
+        REQUIRE(copy.size() == 9);
+        REQUIRE(copy[8].t == 8);
+        REQUIRE(copy.data() != xs.data());
+    }
+
+    SECTION("Rendering allocates nothing once the arenas are warm") {
+        std::vector<Sphere> spheres(12);
+        for (int i = 0; i < 12; i++) {
+            spheres[i].transform = translation(0, 0, i * 0.1f) * scaling(2, 2, 2);
+        }
+        Canvas canvas(24, 24);
+        // one thread, so the second frame runs on the arena the first warmed
+        ThreadPool pool(1);
+        auto shade = [&](int x, int y) {
+            // every ray hits all 12 spheres, 24 intersections
+            Intersections xs(&thread_arena());
+            intersect(spheres, Ray {point(x * 0.01f, y * 0.01f, -5), vector(0, 0, 1)}, xs);
+            return xs.size() == 24 && xs.spilled() ? color(1, 1, 1) : color(1, 0, 0);
+        };
+        render(canvas, shade, {8, &pool});
+        long before = Arena::heap_allocations();
+        render(canvas, shade, {8, &pool});
+        REQUIRE(Arena::heap_allocations() == before);
+        REQUIRE(canvas.pixel_at(23, 23) == color(1, 1, 1));
+    }
+
+    SECTION("Nested tiles leave the outer tile's lists alone") {
+        // one thread, so the outer and inner tiles share an arena
+        ThreadPool pool(1);
+        Intersections before(&thread_arena());
+        for (int i = 0; i < 20; i++) before.push_back({static_cast<float>(i), &s});
+
+        bool intact = true;
+        auto check = [&](const Intersections& xs, float offset) {
+            for (int i = 0; i < 20; i++) {
+                intact = intact && xs[i].t == i + offset;
+            }
+        };
+        for_each_tile(16, 16, [&](const Tile& outer) {
+            Intersections xs(&thread_arena());
+            for (int i = 0; i < 20; i++) {
+                xs.push_back({static_cast<float>(i + outer.x0), &s});
+            }
+            for_each_tile(16, 16, [&](const Tile& inner) {
+                Intersections scratch(&thread_arena());
+                for (int i = 0; i < 20; i++) {
+                    scratch.push_back({static_cast<float>(-1 - inner.y0), &s});
+                }
+            }, {4, &pool});
+            check(xs, outer.x0);
+        }, {8, &pool});
+        check(before, 0);
+        REQUIRE(intact);
+    }
+}
+
+TEST_CASE("Shadow rays", "[bvh]") {
+    unsigned seed = 777;
+    auto random = [&seed](float lo, float hi) {
+        seed = seed * 1664525u + 1013904223u;
+        return lo + (hi - lo) * ((seed >> 8) / 16777216.0f);
+    };
+
+    std::vector<Sphere> spheres(500);
+    for (Sphere& s : spheres) {
+        float r = random(0.1f, 0.6f);
+        s.transform = translation(random(-10, 10), random(-10, 10), random(-10, 10))
+            * scaling(r, r, r);
+    }
+    Bvh bvh(spheres);
+    PointLight light {point(-10, 12, -14), color(1, 1, 1)};
+
+    // a shadow test against every sphere, the way a closest-hit API would
+    auto blocked = [&](const Tuple& p) {
+        Tuple to_light = light.position - p;
+        float distance = to_light.magnitude();
+        Intersections xs;
+        intersect(spheres, Ray {p, normalize(to_light)}, xs);
+        const Intersection* h = hit(xs);
+        return h && h->t < distance;
+    };
+
+    std::vector<Tuple> points;
+    for (int i = 0; i < 300; i++) {
+        points.push_back(point(random(-10, 10), random(-10, 10), random(-10, 10)));
+    }
+
+    SECTION("The book's shadow cases") {
+        Sphere outer;
+        Sphere inner;
+        inner.transform = scaling(0.5, 0.5, 0.5);
+        std::vector<Sphere> world {outer, inner};
+        Bvh small(world);
+        PointLight l {point(-10, 10, -10), color(1, 1, 1)};
+        // nothing collinear with point and light
+        REQUIRE(!small.is_occluded(point(0, 10, 0), l));
+        // an object between the point and the light
+        REQUIRE(small.is_occluded(point(10, -10, 10), l));
+        // an object behind the light
+        REQUIRE(!small.is_occluded(point(-20, 20, -20), l));
+        // an object behind the point
+        REQUIRE(!small.is_occluded(point(-2, 2, -2), l));
+    }
+
+    SECTION("Any-hit agrees with testing every sphere") {
+        BvhTraversalStats stats;
+        int shadowed = 0;
+        for (const Tuple& p : points) {
+            bool expected = blocked(p);
+            CHECK(bvh.is_occluded(p, light, &stats) == expected);
+            shadowed += expected;
+        }
+        REQUIRE(shadowed > 0);
+        REQUIRE(shadowed < 300);
+        REQUIRE(stats.rays == 300);
+        REQUIRE(stats.hits == shadowed);
+        REQUIRE(stats.primitives_per_ray() < 100);
+        REQUIRE(stats.nodes_per_ray() > 0);
+    }
+
+    SECTION("Packets of shadow rays agree with single rays") {
+        BvhTraversalStats single, packed;
+        std::vector<char> occluded(points.size());
+        bvh.is_occluded(points, light, occluded, &packed);
+        for (std::size_t i = 0; i < points.size(); i++) {
+            CHECK(static_cast<bool>(occluded[i]) == bvh.is_occluded(points[i], light, &single));
+        }
+        REQUIRE(packed.rays == 300);
+        REQUIRE(packed.hits == single.hits);
+    }
+
+    SECTION("Any-hit stops early") {
+        Ray r {point(0, 0, -30), vector(0, 0, 1)};
+        BvhTraversalStats any, closest;
+        bool found = bvh.any_hit(r, INFINITY, &any);
+        bvh.closest_hit(r, &closest);
+        REQUIRE(found == (closest.hits == 1));
+        REQUIRE(any.primitives_tested <= closest.primitives_tested);
+        REQUIRE(!bvh.any_hit(r, 0, &any));
+    }
+
+    SECTION("Shadowed hits only get ambient light") {
+        Material m;
+        Tuple p = point(0, 0, 0);
+        Tuple eyev = vector(0, 0, -1);
+        Tuple normalv = vector(0, 0, -1);
+        PointLight l {point(0, 0, -10), color(1, 1, 1)};
+        REQUIRE(lighting(m, l, p, eyev, normalv, true) == color(0.1, 0.1, 0.1));
+
+        HitBatch hits;
+        for (int i = 0; i < 11; i++) hits.push_back(p, eyev, normalv, m);
+        std::vector<char> in_shadow(11);
+        for (int i = 0; i < 11; i += 2) in_shadow[i] = 1;
+        TupleBatch out;
+        lighting(l, hits, in_shadow, out);
+        for (int i = 0; i < 11; i++) {
+            CHECK(out.at(i) == (i % 2 ? color(1.9, 1.9, 1.9) : color(0.1, 0.1, 0.1)));
+        }
+    }
+}